@@ -1,6 +1,8 @@
 #version 330
 
 uniform sampler2D tex;
+//Part of the texture holding the rendered image, which may be smaller than the window
+uniform vec2 texScale;
 
 in Vertex{
 	vec2 texCoord;
@@ -9,5 +11,7 @@ in Vertex{
 out vec4 outColour;
 
 void main(void){
-	outColour = texture(tex, IN.texCoord);
+	//Upscale to the window, keeping the filter away from texels outside the rendered region
+	vec2 halfTexel = 0.5f / vec2(textureSize(tex, 0));
+	outColour = texture(tex, clamp(IN.texCoord * texScale, halfTexel, texScale - halfTexel));
 }
\ No newline at end of file
@@ -0,0 +1,244 @@
+//Frame capture -- see capture.h
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "capture.h"
+
+#include <algorithm>
+
+namespace
+{
+	unsigned char ToByte(float value)
+	{
+		value = std::min(std::max(value, 0.0f), 1.0f);
+		return (unsigned char)(value * 255.0f + 0.5f);
+	}
+}
+
+FrameCapture::FrameCapture(const char *path, CaptureFormat format, CapturePolicy policy, unsigned int frameRate, size_t numSlots)
+	: m_path(path), m_format(format), m_policy(policy), m_frameRate(frameRate), m_file(NULL), m_open(true),
+	  m_streamWidth(0), m_streamHeight(0), m_frameNumber(0), m_pending(0), m_written(0), m_dropped(0), m_lastDropped(false), m_quit(false)
+{
+	if(m_format == CAPTURE_Y4M)
+	{
+		m_file = fopen(path, "wb");
+		m_open = (m_file != NULL);
+	}
+	for(size_t i = 0; i < numSlots; i++)
+		m_freeSlots.push_back((int)i);
+	m_writer = std::thread(&FrameCapture::WriterLoop, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+	Drain();
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_quit = true;
+	}
+	m_jobQueued.notify_one();
+	m_writer.join();
+	if(m_file) fclose(m_file);
+}
+
+int FrameCapture::AcquireSlot()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	if(m_freeSlots.empty())
+	{
+		if(m_policy == CAPTURE_DROP)
+		{
+			m_dropped++;
+			m_lastDropped = true;
+			return -1;
+		}
+		while(m_freeSlots.empty())
+			m_slotFreed.wait(lock);
+	}
+	int slot = m_freeSlots.back();
+	m_freeSlots.pop_back();
+	return slot;
+}
+
+void FrameCapture::Submit(int slot, const float *pixels, size_t width, size_t height, size_t stride, std::function<void()> ready)
+{
+	Job job;
+	job.slot = slot;
+	job.pixels = pixels;
+	job.width = width;
+	job.height = height;
+	job.stride = stride;
+	job.ready = ready;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_lastDropped = false;
+		m_jobs.push_back(job);
+		m_pending++;
+	}
+	m_jobQueued.notify_one();
+}
+
+bool FrameCapture::LastFrameDropped() const
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_lastDropped;
+}
+
+void FrameCapture::RepeatLastFrame()
+{
+	Job job;
+	job.slot = -1;
+	job.pixels = NULL;
+	job.width = job.height = job.stride = 0;
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		//The frame this stands in for never made it, so the last one written would be the wrong picture
+		if(m_lastDropped)
+		{
+			m_dropped++;
+			return;
+		}
+		//The writer is behind while every slot is taken or an earlier repeat is still queued
+		while(m_freeSlots.empty() || (!m_jobs.empty() && m_jobs.back().slot == -1))
+		{
+			if(m_policy == CAPTURE_DROP)
+			{
+				m_dropped++;
+				return;
+			}
+			m_slotFreed.wait(lock);
+		}
+		m_jobs.push_back(job);
+		m_pending++;
+	}
+	m_jobQueued.notify_one();
+}
+
+size_t FrameCapture::FramesWritten() const
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_written;
+}
+
+size_t FrameCapture::FramesDropped() const
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	return m_dropped;
+}
+
+void FrameCapture::Drain()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	while(m_pending > 0)
+		m_slotFreed.wait(lock);
+}
+
+void FrameCapture::WriterLoop()
+{
+	for(;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			while(!m_quit && m_jobs.empty())
+				m_jobQueued.wait(lock);
+			if(m_jobs.empty()) return;
+			job = m_jobs.front();
+			m_jobs.pop_front();
+		}
+
+		if(job.slot >= 0)
+		{
+			//Wait for the readback, then encode straight from the slot
+			if(job.ready) job.ready();
+			WriteFrame(job);
+		}
+		bool written = WriteBytes();
+
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if(written)
+				m_written++;
+			else
+				m_dropped++;
+			if(job.slot >= 0) m_freeSlots.push_back(job.slot);
+			m_pending--;
+		}
+		m_slotFreed.notify_all();
+	}
+}
+
+void FrameCapture::WriteFrame(const Job &job)
+{
+	if(m_format == CAPTURE_PPM)
+	{
+		//Packed RGB, top row first
+		m_streamWidth = job.width;
+		m_streamHeight = job.height;
+		m_bytes.resize(job.width*job.height*3);
+		for(size_t y = 0; y < job.height; y++)
+		{
+			for(size_t x = 0; x < job.width; x++)
+			{
+				const float *p = &job.pixels[(y*job.stride + x)*4];
+				unsigned char *out = &m_bytes[(y*job.width + x)*3];
+				out[0] = ToByte(p[0]);
+				out[1] = ToByte(p[1]);
+				out[2] = ToByte(p[2]);
+			}
+		}
+		return;
+	}
+
+	//Y4M: the first frame fixes the stream size
+	if(m_streamWidth == 0)
+	{
+		m_streamWidth = job.width;
+		m_streamHeight = job.height;
+		fprintf(m_file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", (unsigned int)m_streamWidth, (unsigned int)m_streamHeight, m_frameRate);
+	}
+	//Planar BT.601 Y'CbCr, nearest-neighbour resampled if the render resolution has changed since
+	size_t planeSize = m_streamWidth*m_streamHeight;
+	m_bytes.resize(planeSize*3);
+	for(size_t y = 0; y < m_streamHeight; y++)
+	{
+		size_t srcY = y * job.height / m_streamHeight;
+		for(size_t x = 0; x < m_streamWidth; x++)
+		{
+			size_t srcX = x * job.width / m_streamWidth;
+			const float *p = &job.pixels[(srcY*job.stride + srcX)*4];
+			float r = std::min(std::max(p[0], 0.0f), 1.0f);
+			float g = std::min(std::max(p[1], 0.0f), 1.0f);
+			float b = std::min(std::max(p[2], 0.0f), 1.0f);
+			size_t i = y*m_streamWidth + x;
+			m_bytes[i] = (unsigned char)(16.0f + 65.481f*r + 128.553f*g + 24.966f*b + 0.5f);
+			m_bytes[planeSize + i] = (unsigned char)(128.0f - 37.797f*r - 74.203f*g + 112.0f*b + 0.5f);
+			m_bytes[planeSize*2 + i] = (unsigned char)(128.0f + 112.0f*r - 93.786f*g - 18.214f*b + 0.5f);
+		}
+	}
+}
+
+bool FrameCapture::WriteBytes()
+{
+	//Nothing encoded yet
+	if(m_bytes.empty()) return false;
+
+	if(m_format == CAPTURE_PPM)
+	{
+		char fileName[512];
+		snprintf(fileName, sizeof(fileName), m_path.c_str(), (unsigned int)m_frameNumber);
+		FILE *file = fopen(fileName, "wb");
+		if(file == NULL) return false;
+		fprintf(file, "P6\n%u %u\n255\n", (unsigned int)m_streamWidth, (unsigned int)m_streamHeight);
+		fwrite(&m_bytes[0], 1, m_bytes.size(), file);
+		fclose(file);
+	}
+	else
+	{
+		if(m_file == NULL) return false;
+		fputs("FRAME\n", m_file);
+		fwrite(&m_bytes[0], 1, m_bytes.size(), m_file);
+	}
+	m_frameNumber++;
+	return true;
+}
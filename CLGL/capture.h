@@ -0,0 +1,101 @@
+//Frame capture -- a pool of readback slots and a background thread streaming frames to disk
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//Output formats
+typedef enum
+{
+	CAPTURE_PPM,		//One binary PPM file per frame; the path is a printf pattern for the frame number
+	CAPTURE_Y4M			//Single YUV4MPEG2 (4:4:4) stream; frames are resampled to the size of the first one
+}CaptureFormat;
+
+//What to do when every slot is still waiting to be written
+typedef enum
+{
+	CAPTURE_DROP,		//Skip the frame; the render loop never waits
+	CAPTURE_QUEUE		//Wait for the writer to free a slot
+}CapturePolicy;
+
+class FrameCapture
+{
+public:
+	FrameCapture(const char *path, CaptureFormat format, CapturePolicy policy, unsigned int frameRate, size_t numSlots);
+	//Writes out everything already submitted
+	~FrameCapture();
+
+	bool IsOpen() const { return m_open; }
+
+	//Claim a slot for the next frame; -1 if the frame is to be dropped
+	int AcquireSlot();
+	//Queue a frame of RGBA floats (stride pixels per row) held in the caller's memory for the slot.
+	//ready is called on the writer thread and must return once the pixels are in place.
+	void Submit(int slot, const float *pixels, size_t width, size_t height, size_t stride, std::function<void()> ready);
+	//Whether the most recent frame was dropped, in which case a repeat would show the wrong picture
+	bool LastFrameDropped() const;
+	//Write the previous frame again, for frames where nothing was rendered. Subject to the same policy as
+	//new frames; counted as dropped if the frame it stands in for was dropped itself, so callers should
+	//capture the frame afresh when LastFrameDropped() is set.
+	void RepeatLastFrame();
+	//Block until every submitted frame is on disk, e.g. before the slot memory is freed
+	void Drain();
+
+	size_t FramesWritten() const;
+	//Frames skipped under CAPTURE_DROP or lost to write errors
+	size_t FramesDropped() const;
+
+private:
+	struct Job
+	{
+		//-1: repeat the previous frame
+		int slot;
+		const float *pixels;
+		size_t width, height, stride;
+		std::function<void()> ready;
+	};
+
+	void WriterLoop();
+	void WriteFrame(const Job &job);
+	bool WriteBytes();
+
+	//Not copyable
+	FrameCapture(const FrameCapture&);
+	FrameCapture &operator=(const FrameCapture&);
+
+	std::string m_path;
+	CaptureFormat m_format;
+	CapturePolicy m_policy;
+	unsigned int m_frameRate;
+	FILE *m_file;
+	bool m_open;
+
+	//Encoded bytes of the last frame, and the size of the Y4M stream
+	std::vector<unsigned char> m_bytes;
+	size_t m_streamWidth, m_streamHeight;
+	size_t m_frameNumber;
+
+	//Slots not waiting to be written, and frames waiting for the writer
+	std::vector<int> m_freeSlots;
+	std::deque<Job> m_jobs;
+	size_t m_pending;
+	size_t m_written, m_dropped;
+	//Whether the most recent frame was dropped rather than submitted
+	bool m_lastDropped;
+
+	mutable std::mutex m_lock;
+	std::condition_variable m_slotFreed;
+	std::condition_variable m_jobQueued;
+	bool m_quit;
+	std::thread m_writer;
+};
+
+#endif
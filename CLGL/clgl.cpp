@@ -14,9 +14,14 @@
 #include <string.h>
 #include <vector>
 #include <iterator>
+#include <algorithm>
 #include <ctime>
+#include <cmath>
+#include <chrono>
 
 #include "data.h"
+#include "cpuraster.h"
+#include "capture.h"
 
 #include <CL\cl.hpp>
 
@@ -35,10 +40,24 @@ cl::Program clProgram;
 cl::CommandQueue clQueue;
 cl::Kernel clKernels[NUM_KERNELS];
 cl::Image2D clImg;
+cl::ImageGL clTargetImage;
 std::vector<cl::Buffer> clBufferList;
 std::vector<cl::Memory> clInteropList;
 std::vector<cl::Event> clWaitList;
 
+//Execution engine for frames, and the native rasteriser when it is in use
+BackendID g_backend = BACKEND_CL;
+std::auto_ptr<CPURasteriser> pCpuRaster;
+
+//Frame capture: the writer, its readback slots (pinned and host-mapped under OpenCL),
+//a device-side copy of the target per slot to read back from once it is released,
+//and a queue of its own for the reads so they never hold up the next frame on clQueue
+std::auto_ptr<FrameCapture> pCapture;
+std::vector<cl::Buffer> clCaptureBuffers;
+std::vector<float*> g_captureSlots;
+std::vector<cl::Buffer> clCaptureStaging;
+cl::CommandQueue clCaptureQueue;
+
 using namespace std;
 
 //Pointer to image data
@@ -54,6 +73,53 @@ cl_ulong uStartTime, uEndTime, uTotalTime;
 //Mutable global for number of triangles; clumsy but quick
 size_t g_numTriangles = NUM_TRIANGLES_DEFAULT;
 
+//Samples per pixel: 1 uses the plain half-space kernel, 4 or 8 the multisampled one
+unsigned int g_msaaSamples = 1;
+
+//Host copy of the scene, so triangles can be edited between frames
+std::vector<int> g_sceneVerts;
+std::vector<float> g_sceneColours;
+//Scene triangles scaled to the render resolution in fixed point, with those outside the guard band clipped to it
+std::vector<int> g_renderVerts;
+std::vector<float> g_renderColours;
+size_t g_numRenderTriangles = 0;
+//Scene triangles the render triangles were built from, and where each one's render triangles start
+//(clipping can split a scene triangle into several; the last entry is the total)
+size_t g_renderedSceneTriangles = 0;
+std::vector<size_t> g_renderFirst(1, 0);
+//Number of triangles the device buffers can hold
+size_t g_triangleCapacity = 0;
+//First scene triangle from which every render copy is out of date (g_numTriangles when up to date),
+//and edited triangles before it that can be rewritten on their own
+size_t g_firstChangedTriangle = 0;
+std::vector<size_t> g_modifiedTriangles;
+
+//Fractional bits of the render vertices (0 = integer pixels) as asked for and as used, and the guard band
+//(a power of two, in pixels either side of the origin) every render vertex lies within
+unsigned int g_requestedSubpixelBits = 0;
+unsigned int g_subpixelBits = 0;
+unsigned int g_guardBandBits = 0;
+
+//Screen tiles: dirty flags and the (x, y) list of tiles to render in the next frame
+size_t g_tilesX, g_tilesY;
+std::vector<bool> g_dirtyTiles;
+std::vector<cl_int> g_tileList;
+//Only re-rasterise dirty tiles, keeping the rest of the previous frame
+bool g_incremental = false;
+
+//Window size, set by the reshape callback
+size_t g_windowWidth = WIDTH, g_windowHeight = HEIGHT;
+bool g_windowResized = false;
+//Render target texture size, and the region of it the kernels rasterise into
+size_t g_texWidth = WIDTH, g_texHeight = HEIGHT;
+size_t g_renderWidth = WIDTH, g_renderHeight = HEIGHT;
+
+//Dynamic resolution: kernel time budget per frame in nanoseconds (0 = fixed resolution)
+unsigned long int g_targetKernelTime = 0;
+float g_renderScale = 1.0f;
+double g_avgKernelTime = 0.0;
+unsigned int g_framesSinceScale = 0;
+
 char* ReadShader(const char* cFileName, size_t* size) {
 	//Standard C-like file read for the shaders
 	FILE *handle;
@@ -221,12 +287,12 @@ void InitGL()
 #ifdef DEBUG
 	glfwOpenWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
 #endif
-	////Set initial window dimensions
-	//gWindowWidth = 800;
-	//gWindowHeight = 600;
+	//Set initial window dimensions
+	g_windowWidth = WIDTH;
+	g_windowHeight = HEIGHT;
 
 	//Open OpenGL window
-	if(!glfwOpenWindow(WIDTH, HEIGHT, 0, 0, 0, 0, 0, 0, GLFW_WINDOW))
+	if(!glfwOpenWindow(g_windowWidth, g_windowHeight, 0, 0, 0, 0, 0, 0, GLFW_WINDOW))
 	{
 		printf("Failed to open window.\n");
 		system("pause");
@@ -281,7 +347,12 @@ void InitCL()
 		std::string progFile = ReadKernels(KERNEL_FILE);
 		cl::Program::Sources clSource(1, std::make_pair(progFile.c_str(), progFile.size()));
 		clProgram = cl::Program(clContext, clSource);
-		clProgram.build(clDeviceList);
+		//Share tiling constants with the kernels
+		std::ostringstream buildOptions;
+		buildOptions << "-D TILE_SIZE=" << TILE_SIZE
+			<< " -D MSAA_MAX_SAMPLES=" << MSAA_MAX_SAMPLES
+			<< " -D MSAA_EDGE_SLOTS=" << MSAA_EDGE_SLOTS;
+		clProgram.build(clDeviceList, buildOptions.str().c_str());
 		//Initialize kernels
 		for(int i=0; i<NUM_KERNELS; i++)
 		{
@@ -289,6 +360,8 @@ void InitCL()
 		}
 		//Create Command Queue with profiling enabled
 		clQueue = cl::CommandQueue(clContext, clDeviceList[0], CL_QUEUE_PROFILING_ENABLE);
+		//Capture readbacks run alongside rendering
+		clCaptureQueue = cl::CommandQueue(clContext, clDeviceList[0]);
 	}
 	catch(cl::Error e)
 	{
@@ -370,7 +443,9 @@ void LoadTextureFromFile()
 void InitGLTexture()
 {
 	//Allocate host memory for image data
-	imgData = new float[4 * WIDTH * HEIGHT];
+	g_texWidth = g_windowWidth;
+	g_texHeight = g_windowHeight;
+	imgData = new float[4 * g_texWidth * g_texHeight];
 
 	//Enable and configure texture
 	glEnable(GL_TEXTURE_2D);
@@ -378,7 +453,7 @@ void InitGLTexture()
 	
 	//Provide image and set parameters
 	glBindTexture(GL_TEXTURE_2D, glTexObj);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, WIDTH, HEIGHT, 0, GL_RGBA, GL_FLOAT, imgData);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, g_texWidth, g_texHeight, 0, GL_RGBA, GL_FLOAT, imgData);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -404,6 +479,7 @@ void SetCLRenderTarget()
 		cl::ImageGL clTexObj(clContext, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, glTexObj);
 		//Add to interop object list
 		clInteropList.push_back(clTexObj);
+		clTargetImage = clTexObj;
 	}
 	catch(cl::Error e)
 	{
@@ -418,6 +494,12 @@ void GenerateTriangles(unsigned int numTriangles, int hfwd, int ht)
 {
 	//local variables 
 	int vPos, cPos, moveX, moveY;
+	//Room for the translations, in whole pixels
+	int rangeX = WIDTH - hfwd*2;
+	int rangeY = HEIGHT - ht;
+	//Vertices are in fixed point with SCENE_SUBPIXEL_BITS fractional bits
+	hfwd <<= SCENE_SUBPIXEL_BITS;
+	ht <<= SCENE_SUBPIXEL_BITS;
 	//Allocate memory for output
 	size_t memSize = numTriangles*3*2;
 	vertData = new int[memSize];
@@ -440,9 +522,9 @@ void GenerateTriangles(unsigned int numTriangles, int hfwd, int ht)
 		//find correct position in dest arrays
 		vPos = i*6;
 		cPos = i*4;
-		//random translation in NDC for vertices
-		moveX = int(rand() % (WIDTH - hfwd*2));
-		moveY = int(rand() % (HEIGHT - ht));
+		//random translation in NDC for vertices, whole pixels plus a fraction
+		moveX = (int(rand() % rangeX) << SCENE_SUBPIXEL_BITS) + rand() % (1 << SCENE_SUBPIXEL_BITS);
+		moveY = (int(rand() % rangeY) << SCENE_SUBPIXEL_BITS) + rand() % (1 << SCENE_SUBPIXEL_BITS);
 		//Looks like we're doing it the long way for now, maybe tidy up later...
 		vertData[0 + vPos] = 0 + moveX;
 		vertData[1 + vPos] = 0 + moveY;
@@ -477,6 +559,8 @@ void InitCLBuffers()
 		cout << "Generating..." << endl;
 		GenerateTriangles(g_numTriangles, hw, ht);
 		cout << "Done." << endl;
+		//The native backend works from the host copy of the scene
+		if(g_backend != BACKEND_CL) return;
 		cout << "Creating Buffers..." << endl;
 		try
 		{
@@ -498,6 +582,7 @@ void InitCLBuffers()
 	}
 	else{
 		cout << "Using hard-coded test data." << endl;
+		if(g_backend != BACKEND_CL) return;
 		try
 		{
 			//Create buffers from triangle data on the host and add to buffer list
@@ -521,6 +606,9 @@ void SetCLArgs()
 {
 	//Red kernel
 	clKernels[RED].setArg<cl::Memory>(0, clInteropList[0]);
+	//Fill kernel, clearing the target
+	clKernels[FILL].setArg<cl::Memory>(0, clInteropList[0]);
+	clKernels[FILL].setArg(1, sizeof(cl_float4), clearColour);
 	//Bounding rectangle kernel
 	clKernels[BOUND_RECT].setArg<cl::Buffer>(0, clBufferList[VERTS]);
 	clKernels[BOUND_RECT].setArg<cl::Buffer>(1, clBufferList[BOUNDS]);
@@ -532,6 +620,693 @@ void SetCLArgs()
 	clKernels[TRIANGLE_BOX].setArg<cl::Buffer>(0, clBufferList[VERTS]);
 	clKernels[TRIANGLE_BOX].setArg<cl::Buffer>(1, clBufferList[COLOURS]);
 	clKernels[TRIANGLE_BOX].setArg<cl::Memory>(2, clInteropList[0]);
+	//Multisampled half-space
+	clKernels[TRIANGLE_MSAA].setArg<cl::Buffer>(0, clBufferList[VERTS]);
+	clKernels[TRIANGLE_MSAA].setArg<cl::Buffer>(1, clBufferList[COLOURS]);
+	clKernels[TRIANGLE_MSAA].setArg<cl_uint>(2, (cl_uint)g_numRenderTriangles);
+	clKernels[TRIANGLE_MSAA].setArg<cl_uint>(3, (cl_uint)g_msaaSamples);
+	clKernels[TRIANGLE_MSAA].setArg(4, sizeof(cl_float4), clearColour);
+	clKernels[TRIANGLE_MSAA].setArg<cl::Buffer>(5, clBufferList[TILES]);
+	cl_int2 renderSize = {{(cl_int)g_renderWidth, (cl_int)g_renderHeight}};
+	clKernels[TRIANGLE_MSAA].setArg<cl_int2>(6, renderSize);
+	clKernels[TRIANGLE_MSAA].setArg<cl_uint>(7, (cl_uint)g_subpixelBits);
+	clKernels[TRIANGLE_MSAA].setArg<cl::Memory>(8, clInteropList[0]);
+}
+
+//Scene coordinates are in render target texels with SCENE_SUBPIXEL_BITS fractional bits; these map them to the
+//(possibly reduced) render resolution, in fixed point with g_subpixelBits fractional bits, rounding to nearest
+long long ToRender(int v, size_t renderSize, size_t texSize)
+{
+	long long den = (long long)texSize << SCENE_SUBPIXEL_BITS;
+	long long num = v * ((long long)renderSize << g_subpixelBits) + den/2;
+	//Floor division, so coordinates left of or above the target round the same way
+	return num >= 0 ? num / den : -((den - 1 - num) / den);
+}
+
+long long ToRenderX(int x)
+{
+	return ToRender(x, g_renderWidth, g_texWidth);
+}
+
+long long ToRenderY(int y)
+{
+	return ToRender(y, g_renderHeight, g_texHeight);
+}
+
+void MarkAllTilesDirty()
+{
+	std::fill(g_dirtyTiles.begin(), g_dirtyTiles.end(), true);
+}
+
+void MarkTilesDirty(int minX, int minY, int maxX, int maxY)
+{
+	//Clamp the pixel rectangle to the screen
+	minX = std::max(minX, 0);
+	minY = std::max(minY, 0);
+	maxX = std::min(maxX, (int)g_renderWidth - 1);
+	maxY = std::min(maxY, (int)g_renderHeight - 1);
+	if(minX > maxX || minY > maxY) return;
+
+	for(int ty = minY / (int)TILE_SIZE; ty <= maxY / (int)TILE_SIZE; ty++)
+		for(int tx = minX / (int)TILE_SIZE; tx <= maxX / (int)TILE_SIZE; tx++)
+			g_dirtyTiles[ty*g_tilesX + tx] = true;
+}
+
+void MarkTriangleTiles(size_t id)
+{
+	const int *v = &g_sceneVerts[id*6];
+	//Bounding box in whole pixels at render resolution, grown by a pixel to cover the sample offsets of the tiled kernel
+	int minX = (int)(ToRenderX(std::min(std::min(v[0], v[2]), v[4])) >> g_subpixelBits) - 1;
+	int minY = (int)(ToRenderY(std::min(std::min(v[1], v[3]), v[5])) >> g_subpixelBits) - 1;
+	int maxX = (int)(ToRenderX(std::max(std::max(v[0], v[2]), v[4])) >> g_subpixelBits) + 1;
+	int maxY = (int)(ToRenderY(std::max(std::max(v[1], v[3]), v[5])) >> g_subpixelBits) + 1;
+	MarkTilesDirty(minX, minY, maxX, maxY);
+}
+
+void CreateTileBuffer()
+{
+	//Room for every tile of the render target texture
+	size_t maxTiles = ((g_texWidth + TILE_SIZE - 1) / TILE_SIZE) * ((g_texHeight + TILE_SIZE - 1) / TILE_SIZE);
+	g_tileList.reserve(2*maxTiles);
+	if(g_backend != BACKEND_CL) return;
+	try
+	{
+		cl::Buffer clTileBuffer(clContext, CL_MEM_READ_ONLY, sizeof(cl_int)*2*maxTiles, NULL);
+		if(clBufferList.size() > TILES)
+			clBufferList[TILES] = clTileBuffer;
+		else
+			clBufferList.push_back(clTileBuffer);
+	}
+	catch(cl::Error e)
+	{
+		cout << "OpenCL memory object failure: " << e.what() << endl
+			<< "Error code: " << e.err() << endl;
+		throw;
+	}
+}
+
+void SetRenderResolution(float scale)
+{
+	//Rasterise into the top-left part of the render target
+	g_renderScale = scale;
+	g_renderWidth = std::max((size_t)(g_texWidth * scale), TILE_SIZE);
+	g_renderHeight = std::max((size_t)(g_texHeight * scale), TILE_SIZE);
+	g_renderWidth = std::min(g_renderWidth, g_texWidth);
+	g_renderHeight = std::min(g_renderHeight, g_texHeight);
+
+	//Everything needs drawing at the new resolution
+	g_tilesX = (g_renderWidth + TILE_SIZE - 1) / TILE_SIZE;
+	g_tilesY = (g_renderHeight + TILE_SIZE - 1) / TILE_SIZE;
+	g_dirtyTiles.assign(g_tilesX*g_tilesY, true);
+	//Device vertices are stored at render resolution, so all of them need re-scaling
+	g_firstChangedTriangle = 0;
+}
+
+void InitScene()
+{
+	//Keep a host copy of whichever triangle data went into the buffers
+	const float *colours = colourData ? colourData : triColours;
+	if(vertData)
+		g_sceneVerts.assign(vertData, vertData + 6*g_numTriangles);
+	else
+	{
+		//The hard-coded test data is in whole pixels
+		g_sceneVerts.resize(6*g_numTriangles);
+		for(size_t i = 0; i < 6*g_numTriangles; i++)
+			g_sceneVerts[i] = triPixVerts[i] * (1 << SCENE_SUBPIXEL_BITS);
+	}
+	g_sceneColours.assign(colours, colours + 4*g_numTriangles);
+	g_triangleCapacity = g_numTriangles;
+	g_firstChangedTriangle = g_numTriangles;
+
+	CreateTileBuffer();
+	SetRenderResolution(1.0f);
+}
+
+//Scene edits: verts are three x, y pairs in render target texels with SCENE_SUBPIXEL_BITS fractional bits
+void AddTriangle(const int *verts, const float *colour)
+{
+	g_sceneVerts.insert(g_sceneVerts.end(), verts, verts + 6);
+	g_sceneColours.insert(g_sceneColours.end(), colour, colour + 4);
+	g_firstChangedTriangle = std::min(g_firstChangedTriangle, g_numTriangles);
+	MarkTriangleTiles(g_numTriangles++);
+}
+
+void RemoveTriangle(size_t id)
+{
+	if(id >= g_numTriangles) return;
+	//Tiles it used to cover must be redrawn without it
+	MarkTriangleTiles(id);
+	g_sceneVerts.erase(g_sceneVerts.begin() + id*6, g_sceneVerts.begin() + id*6 + 6);
+	g_sceneColours.erase(g_sceneColours.begin() + id*4, g_sceneColours.begin() + id*4 + 4);
+	g_numTriangles--;
+	//Later triangles shift down, so their device copies are stale too
+	g_firstChangedTriangle = std::min(g_firstChangedTriangle, id);
+}
+
+void ModifyTriangle(size_t id, const int *verts, const float *colour)
+{
+	if(id >= g_numTriangles) return;
+	//Mark the tiles covered both before and after the change
+	MarkTriangleTiles(id);
+	std::copy(verts, verts + 6, g_sceneVerts.begin() + id*6);
+	std::copy(colour, colour + 4, g_sceneColours.begin() + id*4);
+	MarkTriangleTiles(id);
+	g_modifiedTriangles.push_back(id);
+}
+
+void ClipToGuardBand(const int *verts, const float *colour)
+{
+	//Sutherland-Hodgman against the four guard band edges, at render resolution
+	double limit = (double)(1 << g_guardBandBits);
+	double sceneUnit = (double)(1 << SCENE_SUBPIXEL_BITS);
+	std::vector<double> polygon, clipped;
+	for(int i=0; i<3; i++)
+	{
+		polygon.push_back(verts[i*2] * (double)g_renderWidth / (g_texWidth * sceneUnit));
+		polygon.push_back(verts[i*2 + 1] * (double)g_renderHeight / (g_texHeight * sceneUnit));
+	}
+	for(int edge=0; edge<4; edge++)
+	{
+		//Edges in turn: x >= -limit, x <= limit, y >= -limit, y <= limit
+		int axis = edge / 2;
+		double sign = (edge % 2) ? -1.0 : 1.0;
+		size_t numVerts = polygon.size()/2;
+		clipped.clear();
+		for(size_t i = 0; i < numVerts; i++)
+		{
+			size_t j = (i + 1) % numVerts;
+			double di = sign*polygon[i*2 + axis] + limit;
+			double dj = sign*polygon[j*2 + axis] + limit;
+			if(di >= 0.0)
+			{
+				clipped.push_back(polygon[i*2]);
+				clipped.push_back(polygon[i*2 + 1]);
+			}
+			if((di >= 0.0) != (dj >= 0.0))
+			{
+				double t = di / (di - dj);
+				clipped.push_back(polygon[i*2] + t*(polygon[j*2] - polygon[i*2]));
+				clipped.push_back(polygon[i*2 + 1] + t*(polygon[j*2 + 1] - polygon[i*2 + 1]));
+			}
+		}
+		polygon.swap(clipped);
+	}
+
+	//Fan the clipped polygon out into triangles with the original winding, in fixed point
+	double unit = (double)(1 << g_subpixelBits);
+	double fixedLimit = limit * unit;
+	size_t numVerts = polygon.size()/2;
+	for(size_t i = 1; i + 1 < numVerts; i++)
+	{
+		size_t corners[3] = {0, i, i + 1};
+		for(int c=0; c<3; c++)
+		{
+			for(int axis=0; axis<2; axis++)
+			{
+				double value = floor(polygon[corners[c]*2 + axis] * unit + 0.5);
+				g_renderVerts.push_back((int)std::min(std::max(value, -fixedLimit), fixedLimit));
+			}
+		}
+		g_renderColours.insert(g_renderColours.end(), colour, colour + 4);
+	}
+}
+
+bool ToRenderTriangle(const int *verts, int *renderVerts)
+{
+	//Fixed-point render coordinates; false if the triangle reaches past the guard band
+	long long limit = (1LL << g_guardBandBits) << g_subpixelBits;
+	long long fixed[6];
+	for(int i=0; i<3; i++)
+	{
+		fixed[i*2] = ToRenderX(verts[i*2]);
+		fixed[i*2 + 1] = ToRenderY(verts[i*2 + 1]);
+		if(fixed[i*2] < -limit || fixed[i*2] > limit || fixed[i*2 + 1] < -limit || fixed[i*2 + 1] > limit) return false;
+	}
+	for(int i=0; i<6; i++)
+		renderVerts[i] = (int)fixed[i];
+	return true;
+}
+
+bool AppendRenderTriangle(const int *verts, const float *colour)
+{
+	//Almost every triangle lies inside the guard band and goes through unclipped
+	int renderVerts[6];
+	if(!ToRenderTriangle(verts, renderVerts))
+	{
+		ClipToGuardBand(verts, colour);
+		return false;
+	}
+	g_renderVerts.insert(g_renderVerts.end(), renderVerts, renderVerts + 6);
+	g_renderColours.insert(g_renderColours.end(), colour, colour + 4);
+	return true;
+}
+
+size_t BuildRenderTriangles(size_t first)
+{
+	//Rebuild the render triangles of scene triangle first onwards
+	first = std::min(first, g_renderFirst.size() - 1);
+	size_t renderFirst = g_renderFirst[first];
+	g_renderVerts.resize(6*renderFirst);
+	g_renderColours.resize(4*renderFirst);
+	g_renderFirst.resize(first + 1);
+	for(size_t i = first; i < g_numTriangles; i++)
+	{
+		AppendRenderTriangle(&g_sceneVerts[i*6], &g_sceneColours[i*4]);
+		g_renderFirst.push_back(g_renderVerts.size()/6);
+	}
+	g_numRenderTriangles = g_renderVerts.size()/6;
+	g_renderedSceneTriangles = g_numTriangles;
+	//First render triangle that changed
+	return renderFirst;
+}
+
+void UploadTriangles(size_t first, size_t count)
+{
+	clQueue.enqueueWriteBuffer(clBufferList[VERTS], CL_FALSE, sizeof(int)*6*first, sizeof(int)*6*count, &g_renderVerts[first*6]);
+	clQueue.enqueueWriteBuffer(clBufferList[COLOURS], CL_FALSE, sizeof(float)*4*first, sizeof(float)*4*count, &g_renderColours[first*4]);
+}
+
+//Returns true if the scene changed; writes to the device read straight from the host vectors
+bool UploadScene()
+{
+	bool changed = false;
+
+	//Edited triangles that had a single render triangle and still fit the guard band are rewritten in place
+	std::vector<size_t> inPlace;
+	std::sort(g_modifiedTriangles.begin(), g_modifiedTriangles.end());
+	g_modifiedTriangles.erase(std::unique(g_modifiedTriangles.begin(), g_modifiedTriangles.end()), g_modifiedTriangles.end());
+	for(size_t i = 0; i < g_modifiedTriangles.size(); i++)
+	{
+		size_t id = g_modifiedTriangles[i];
+		//Later triangles are rebuilt with the tail anyway
+		if(id >= g_firstChangedTriangle) break;
+		size_t renderId = g_renderFirst[id];
+		if(g_renderFirst[id + 1] == renderId + 1 && ToRenderTriangle(&g_sceneVerts[id*6], &g_renderVerts[renderId*6]))
+		{
+			std::copy(g_sceneColours.begin() + id*4, g_sceneColours.begin() + id*4 + 4, g_renderColours.begin() + renderId*4);
+			inPlace.push_back(renderId);
+		}
+		else
+			g_firstChangedTriangle = id;
+	}
+	g_modifiedTriangles.clear();
+	changed = !inPlace.empty();
+
+	if(g_firstChangedTriangle < g_numTriangles || g_renderedSceneTriangles != g_numTriangles)
+	{
+		changed = true;
+		size_t first = BuildRenderTriangles(g_firstChangedTriangle);
+		if(g_numRenderTriangles > g_triangleCapacity)
+		{
+			//Out of room: re-create the triangle buffers with some headroom
+			g_triangleCapacity = g_numRenderTriangles*2;
+			if(g_backend == BACKEND_CL)
+			{
+				clBufferList[VERTS] = cl::Buffer(clContext, CL_MEM_READ_WRITE, sizeof(int)*6*g_triangleCapacity, NULL);
+				clBufferList[COLOURS] = cl::Buffer(clContext, CL_MEM_READ_ONLY, sizeof(float)*4*g_triangleCapacity, NULL);
+				clBufferList[BOUNDS] = cl::Buffer(clContext, CL_MEM_WRITE_ONLY, sizeof(int)*4*g_triangleCapacity, NULL);
+				SetCLArgs();
+			}
+			first = 0;
+		}
+		//Only the changed tail goes to the device
+		if(g_backend == BACKEND_CL && first < g_numRenderTriangles) UploadTriangles(first, g_numRenderTriangles - first);
+		//In-place edits the tail now covers are already on their way
+		while(!inPlace.empty() && inPlace.back() >= first) inPlace.pop_back();
+	}
+
+	//Runs of consecutive in-place edits go up together
+	if(g_backend == BACKEND_CL)
+	{
+		for(size_t i = 0; i < inPlace.size();)
+		{
+			size_t run = 1;
+			while(i + run < inPlace.size() && inPlace[i + run] == inPlace[i] + run) run++;
+			UploadTriangles(inPlace[i], run);
+			i += run;
+		}
+		clKernels[TRIANGLE_MSAA].setArg<cl_uint>(2, (cl_uint)g_numRenderTriangles);
+	}
+	g_firstChangedTriangle = g_numTriangles;
+	return changed;
+}
+
+size_t BuildTileList()
+{
+	//Collect the dirty tiles and clear their flags
+	g_tileList.clear();
+	for(size_t ty = 0; ty < g_tilesY; ty++)
+	{
+		for(size_t tx = 0; tx < g_tilesX; tx++)
+		{
+			if(g_dirtyTiles[ty*g_tilesX + tx])
+			{
+				g_tileList.push_back((cl_int)tx);
+				g_tileList.push_back((cl_int)ty);
+				g_dirtyTiles[ty*g_tilesX + tx] = false;
+			}
+		}
+	}
+	return g_tileList.size()/2;
+}
+
+void JitterTriangle()
+{
+	//Nudge a random triangle, to exercise incremental updates
+	if(g_numTriangles == 0) return;
+	size_t id = rand() % g_numTriangles;
+	int verts[6];
+	float colour[4];
+	std::copy(g_sceneVerts.begin() + id*6, g_sceneVerts.begin() + id*6 + 6, verts);
+	std::copy(g_sceneColours.begin() + id*4, g_sceneColours.begin() + id*4 + 4, colour);
+	//Up to five pixels either way, in sub-pixel steps
+	int moveX = rand() % (11 << SCENE_SUBPIXEL_BITS) - (5 << SCENE_SUBPIXEL_BITS);
+	int moveY = rand() % (11 << SCENE_SUBPIXEL_BITS) - (5 << SCENE_SUBPIXEL_BITS);
+	for(int i=0; i<3; i++)
+	{
+		verts[i*2] += moveX;
+		verts[i*2 + 1] += moveY;
+	}
+	ModifyTriangle(id, verts, colour);
+}
+
+void AddRandomTriangle()
+{
+	//Drop a new triangle somewhere on the target, shaped like the generated ones
+	int unit = 1 << SCENE_SUBPIXEL_BITS;
+	int halfWidth = (rand() % 40 + 10)*unit + rand() % unit;
+	int height = (rand() % 60 + 10)*unit + rand() % unit;
+	int x = (rand() % (int)g_texWidth)*unit + rand() % unit - halfWidth;
+	int y = (rand() % (int)g_texHeight)*unit + rand() % unit - height/2;
+	int verts[6] = {x, y, x + halfWidth, y + height, x + halfWidth*2, y};
+	float colour[4];
+	for(int i=0; i<3; i++) colour[i] = (float)((rand()% 10)/10.0f);
+	colour[3] = 1.0f;
+	AddTriangle(verts, colour);
+}
+
+void RemoveRandomTriangle()
+{
+	if(g_numTriangles == 0) return;
+	RemoveTriangle(rand() % g_numTriangles);
+}
+
+void SelectBackend()
+{
+	char cRep;
+	cout << "Rasterise with OpenCL or the native CPU backend (o/c)?" << endl;
+	cin >> cRep;
+	g_backend = (cRep == 'c' || cRep == 'C') ? BACKEND_CPU : BACKEND_CL;
+}
+
+void InitCPURasteriser()
+{
+	pCpuRaster.reset(new CPURasteriser(TILE_SIZE));
+	cout << "Native rasteriser: " << pCpuRaster->NumThreads() << " threads, "
+		<< pCpuRaster->InstructionSetName() << " edge evaluation." << endl;
+}
+
+void SelectMultisampling()
+{
+	unsigned int samples;
+	cout << "Select multisampling mode (1 = off, 4 or " << MSAA_MAX_SAMPLES << " samples)." << endl;
+	cin >> samples;
+	if(samples == 4 || samples == MSAA_MAX_SAMPLES)
+		g_msaaSamples = samples;
+	else
+		g_msaaSamples = 1;
+	cout << "Using " << g_msaaSamples << " sample(s) per pixel." << endl;
+}
+
+unsigned int GuardBandBits(unsigned int subpixelBits)
+{
+	//The tiled kernel works in at least 1/16th pixels and steps edge functions in 32 bits across a tile;
+	//edges spanning up to twice the guard band stay clear of overflow
+	unsigned int precision = std::max(subpixelBits, 4u);
+	unsigned int tileBits = 0;
+	while(((size_t)1 << tileBits) < TILE_SIZE) tileBits++;
+	return 28 - 2*precision - tileBits;
+}
+
+void SetSubpixelBits(unsigned int bits)
+{
+	//Fixed point needs at least the 1/16th pixel the sample patterns are placed on
+	g_requestedSubpixelBits = bits;
+	if(bits > 0) bits = std::min(std::max(bits, 4u), MAX_SUBPIXEL_BITS);
+	//The guard band has to cover the whole render target
+	while(bits > 4 && ((size_t)1 << GuardBandBits(bits)) < std::max(g_texWidth, g_texHeight)) bits--;
+	g_subpixelBits = bits;
+	g_guardBandBits = GuardBandBits(bits);
+	//Integer vertices may also go to half_space_box, whose 32-bit products of a vertex difference (up to twice
+	//the band) and a pixel-to-vertex distance (up to the band plus the target size) must each stay below 2^30
+	if(bits == 0)
+	{
+		long long size = (long long)std::max(g_texWidth, g_texHeight);
+		while(g_guardBandBits > 0 && (2LL << g_guardBandBits) * ((1LL << g_guardBandBits) + size) >= (1LL << 30)) g_guardBandBits--;
+	}
+
+	//Render vertices change format
+	g_firstChangedTriangle = 0;
+	MarkAllTilesDirty();
+	if(g_backend == BACKEND_CL) clKernels[TRIANGLE_MSAA].setArg<cl_uint>(7, (cl_uint)g_subpixelBits);
+}
+
+void SelectSubpixelPrecision()
+{
+	unsigned int bits;
+	cout << "Enter sub-pixel precision in bits (0 = integer pixels, 4 to " << MAX_SUBPIXEL_BITS << ")." << endl;
+	cin >> bits;
+	SetSubpixelBits(bits);
+	if(g_subpixelBits > 0)
+		cout << "Using " << g_subpixelBits << " sub-pixel bits with the top-left fill rule";
+	else
+		cout << "Using integer pixel coordinates";
+	cout << "; guard band +/-" << (1 << g_guardBandBits) << " pixels." << endl;
+}
+
+void SelectDynamicResolution()
+{
+	unsigned long int targetTime;
+	cout << "Enter target kernel time per frame in microseconds (0 = fixed resolution)." << endl;
+	cin >> targetTime;
+	g_targetKernelTime = targetTime * 1000;
+}
+
+void AllocateCaptureSlots()
+{
+	//Room for a whole render target per slot
+	size_t slotSize = 4*g_texWidth*g_texHeight;
+	if(g_backend == BACKEND_CPU)
+	{
+		for(size_t i = 0; i < CAPTURE_SLOTS; i++)
+			g_captureSlots.push_back(new float[slotSize]);
+		return;
+	}
+	try
+	{
+		for(size_t i = 0; i < CAPTURE_SLOTS; i++)
+		{
+			clCaptureStaging.push_back(cl::Buffer(clContext, CL_MEM_READ_WRITE, sizeof(float)*slotSize, NULL));
+			//Host-allocated buffers, mapped once, so readbacks go straight into pinned memory
+			cl::Buffer clSlotBuffer(clContext, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, sizeof(float)*slotSize, NULL);
+			clCaptureBuffers.push_back(clSlotBuffer);
+			g_captureSlots.push_back((float*)clQueue.enqueueMapBuffer(clSlotBuffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, sizeof(float)*slotSize));
+		}
+	}
+	catch(cl::Error e)
+	{
+		cout << "OpenCL memory object failure: " << e.what() << endl
+			<< "Error code: " << e.err() << endl;
+		throw;
+	}
+}
+
+void FreeCaptureSlots()
+{
+	//Nothing may still be reading from or writing to the slots
+	pCapture->Drain();
+	if(g_backend == BACKEND_CPU)
+	{
+		for(size_t i = 0; i < g_captureSlots.size(); i++)
+			delete[] g_captureSlots[i];
+	}
+	else
+	{
+		for(size_t i = 0; i < clCaptureBuffers.size(); i++)
+			clQueue.enqueueUnmapMemObject(clCaptureBuffers[i], g_captureSlots[i]);
+		clQueue.finish();
+		clCaptureQueue.finish();
+		clCaptureBuffers.clear();
+		clCaptureStaging.clear();
+	}
+	g_captureSlots.clear();
+}
+
+void SelectCapture()
+{
+	char cRep;
+	cout << "Capture frames to disk (n = no, p = PPM sequence, y = Y4M stream)?" << endl;
+	cin >> cRep;
+	if(cRep != 'p' && cRep != 'P' && cRep != 'y' && cRep != 'Y') return;
+	CaptureFormat format = (cRep == 'p' || cRep == 'P') ? CAPTURE_PPM : CAPTURE_Y4M;
+	cout << "When the writer falls behind, drop frames or wait for it (d/w)?" << endl;
+	cin >> cRep;
+	CapturePolicy policy = (cRep == 'w' || cRep == 'W') ? CAPTURE_QUEUE : CAPTURE_DROP;
+
+	pCapture.reset(new FrameCapture(format == CAPTURE_PPM ? CAPTURE_PPM_FILE : CAPTURE_Y4M_FILE, format, policy, CAPTURE_FRAME_RATE, CAPTURE_SLOTS));
+	if(!pCapture->IsOpen())
+	{
+		cout << "Failed to open the capture file." << endl;
+		pCapture.reset();
+		return;
+	}
+	AllocateCaptureSlots();
+}
+
+void StopCapture()
+{
+	if(!pCapture.get()) return;
+	FreeCaptureSlots();
+	cout << "Captured " << pCapture->FramesWritten() << " frames, dropped " << pCapture->FramesDropped() << "." << endl;
+	pCapture.reset();
+}
+
+int CopyFrameForCaptureCL(cl::Event &copyEvent)
+{
+	//Device-side copy of the rendered region, made while the target is still acquired
+	int slot = pCapture->AcquireSlot();
+	if(slot < 0) return slot;
+	cl::size_t<3> origin;
+	cl::size_t<3> region;
+	origin[0] = origin[1] = origin[2] = 0;
+	region[0] = g_renderWidth;
+	region[1] = g_renderHeight;
+	region[2] = 1;
+	clQueue.enqueueCopyImageToBuffer(clTargetImage, clCaptureStaging[slot], origin, region, 0, NULL, &copyEvent);
+	return slot;
+}
+
+void ReadFrameForCaptureCL(int slot, const cl::Event &copyEvent)
+{
+	//Non-blocking read into the pinned slot on the capture queue, behind the copy; the writer thread waits on the event
+	std::vector<cl::Event> waitList(1, copyEvent);
+	cl::Event readEvent;
+	clCaptureQueue.enqueueReadBuffer(clCaptureStaging[slot], CL_FALSE, 0, sizeof(float)*4*g_renderWidth*g_renderHeight, g_captureSlots[slot], &waitList, &readEvent);
+	clCaptureQueue.flush();
+	pCapture->Submit(slot, g_captureSlots[slot], g_renderWidth, g_renderHeight, g_renderWidth,
+		[readEvent]()
+		{
+			try { readEvent.wait(); }
+			catch(cl::Error) {}
+		});
+}
+
+void CaptureFrameCPU()
+{
+	int slot = pCapture->AcquireSlot();
+	if(slot < 0) return;
+	//Pack the rendered region into the slot
+	for(size_t y = 0; y < g_renderHeight; y++)
+		memcpy(&g_captureSlots[slot][y*g_renderWidth*4], &imgData[y*g_texWidth*4], sizeof(float)*4*g_renderWidth);
+	pCapture->Submit(slot, g_captureSlots[slot], g_renderWidth, g_renderHeight, g_renderWidth, std::function<void()>());
+}
+
+void CaptureUnchangedFrame()
+{
+	//A repeat is only the right picture if the previous frame made it; otherwise read the target back
+	if(!pCapture->LastFrameDropped())
+	{
+		pCapture->RepeatLastFrame();
+		return;
+	}
+	if(g_backend == BACKEND_CPU)
+	{
+		CaptureFrameCPU();
+		return;
+	}
+	glFinish();
+	clQueue.enqueueAcquireGLObjects(&clInteropList);
+	cl::Event copyEvent;
+	int slot = CopyFrameForCaptureCL(copyEvent);
+	cl::Event releaseEvent;
+	clQueue.enqueueReleaseGLObjects(&clInteropList, NULL, &releaseEvent);
+	clQueue.flush();
+	if(slot >= 0) ReadFrameForCaptureCL(slot, copyEvent);
+	releaseEvent.wait();
+}
+
+void ResizeRenderTarget()
+{
+	g_windowResized = false;
+	//The kernels must be done with the old target before it goes
+	if(g_backend == BACKEND_CL)
+	{
+		clQueue.finish();
+		clInteropList.clear();
+	}
+
+	//Re-allocate texture storage at the window size
+	g_texWidth = g_windowWidth;
+	g_texHeight = g_windowHeight;
+	delete[] imgData;
+	imgData = new float[4 * g_texWidth * g_texHeight];
+	glBindTexture(GL_TEXTURE_2D, glTexObj);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, g_texWidth, g_texHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	//New interop image and buffers sized from it
+	if(g_backend == BACKEND_CL) SetCLRenderTarget();
+	CreateTileBuffer();
+	if(pCapture.get())
+	{
+		FreeCaptureSlots();
+		AllocateCaptureSlots();
+	}
+	SetRenderResolution(g_renderScale);
+	//A larger target may need a wider guard band than the current precision allows
+	SetSubpixelBits(g_requestedSubpixelBits);
+	if(g_backend == BACKEND_CL) SetCLArgs();
+}
+
+void UpdateDynamicResolution(unsigned long int kernelTime, size_t numTiles)
+{
+	//Frames with nothing to draw say nothing about the cost of drawing
+	if(kernelTime == 0 || numTiles == 0) return;
+	//Incremental frames only draw the dirty tiles: scale up to what a full frame would cost
+	double frameTime = (double)kernelTime * (double)(g_tilesX*g_tilesY) / (double)numTiles;
+	//Smooth out frame-to-frame noise
+	if(g_avgKernelTime == 0.0)
+		g_avgKernelTime = frameTime;
+	else
+		g_avgKernelTime = 0.9*g_avgKernelTime + 0.1*frameTime;
+	if(++g_framesSinceScale < RENDER_SCALE_SETTLE_FRAMES) return;
+
+	//Kernel time goes roughly with pixel count, i.e. with the square of the scale
+	float scale = g_renderScale * (float)sqrt(g_targetKernelTime / g_avgKernelTime);
+	scale = std::min(std::max(scale, MIN_RENDER_SCALE), 1.0f);
+	//Round down to whole steps, so a step up is only taken when it fits in the budget
+	scale = floor(scale / RENDER_SCALE_STEP) * RENDER_SCALE_STEP;
+	scale = std::max(scale, MIN_RENDER_SCALE);
+	if(scale == g_renderScale) return;
+
+	SetRenderResolution(scale);
+	if(g_backend == BACKEND_CL)
+	{
+		cl_int2 renderSize = {{(cl_int)g_renderWidth, (cl_int)g_renderHeight}};
+		clKernels[TRIANGLE_MSAA].setArg<cl_int2>(6, renderSize);
+	}
+	//Start measuring afresh at the new resolution
+	g_framesSinceScale = 0;
+	g_avgKernelTime = 0.0;
+}
+
+void SelectIncrementalRendering()
+{
+	char cRep;
+	cout << "Only re-render changed tiles (y/n)?" << endl;
+	cin >> cRep;
+	g_incremental = (cRep == 'y' || cRep == 'Y');
 }
 
 void ConfigureData()
@@ -542,33 +1317,118 @@ void ConfigureData()
 	InitGLTexture();
 	InitGLShaders();
 	//Configure OpenCL render/interop target
-	SetCLRenderTarget();
+	if(g_backend == BACKEND_CL) SetCLRenderTarget();
 	//Create CL buffer objects
 	cout << "CL Buffers..." << endl;
 	InitCLBuffers();
+	InitScene();
+	//Choose rasterisation mode; the native backend is single-sampled
+	if(g_backend == BACKEND_CL) SelectMultisampling();
+	SelectSubpixelPrecision();
+	SelectIncrementalRendering();
+	SelectDynamicResolution();
+	SelectCapture();
 	//Set kernel Arguments
-	SetCLArgs();
+	if(g_backend == BACKEND_CL)
+		SetCLArgs();
+	else
+		InitCPURasteriser();
+}
+
+void RenderTilesCPU(size_t numTiles)
+{
+	//Rasterise straight into the host copy of the render target
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	pCpuRaster->Render(g_renderVerts.empty() ? NULL : &g_renderVerts[0], g_renderColours.empty() ? NULL : &g_renderColours[0], g_numRenderTriangles,
+		g_subpixelBits, &g_tileList[0], numTiles, clearColour, imgData, g_texWidth, g_renderWidth, g_renderHeight);
+	std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+	uStartTime = 0;
+	uEndTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+	//Upload the rows holding rendered tiles (the list is in row order)
+	size_t firstRow = g_tileList[1] * TILE_SIZE;
+	size_t endRow = std::min((g_tileList[numTiles*2 - 1] + 1) * TILE_SIZE, g_renderHeight);
+	glBindTexture(GL_TEXTURE_2D, glTexObj);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow, g_texWidth, endRow - firstRow, GL_RGBA, GL_FLOAT, &imgData[firstRow*g_texWidth*4]);
+	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 unsigned long int ExecuteKernels()
 {
+	//Screen tiles drawn this frame (0 for the untiled kernel)
+	size_t numTiles;
 	try
 	{
 		//Profiling event
 		cl::Event profEvent;
-		//Make sure OpenGL processing is finished
-		glFinish();
-		//Get exclusive access to GL texture object
-		clQueue.enqueueAcquireGLObjects(&clInteropList);
-		//Execute kernels
-		clQueue.enqueueNDRangeKernel(clKernels[TRIANGLE_BOX], cl::NullRange, cl::NDRange(WIDTH, HEIGHT, g_numTriangles), cl::NullRange, NULL, &profEvent);
-		//Release texture object
-		clQueue.enqueueReleaseGLObjects(&clInteropList);
-		//Finish OpenCL processing
-		clQueue.finish();
-		//Get the profiling info
-		profEvent.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &uStartTime);
-		profEvent.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &uEndTime);
+		//Pick up a new window size
+		if(g_windowResized) ResizeRenderTarget();
+		//Tiled kernel: native backend, multisampling, fixed-point vertices, incremental rendering or a scaled resolution
+		bool tiled = g_backend == BACKEND_CPU || g_msaaSamples > 1 || g_subpixelBits > 0 || g_incremental || g_targetKernelTime > 0;
+		numTiles = 0;
+		//Send any scene edits to the device
+		bool sceneChanged = UploadScene();
+		if(tiled)
+		{
+			//Full redraw unless only dirty tiles are wanted
+			if(!g_incremental) MarkAllTilesDirty();
+			numTiles = BuildTileList();
+			//Nothing changed: the previous frame stays as it is
+			if(numTiles == 0)
+			{
+				//Edits that touched no on-screen tile still have writes reading from host memory the next edit may move
+				if(sceneChanged && g_backend == BACKEND_CL) clQueue.finish();
+				if(pCapture.get()) CaptureUnchangedFrame();
+				return 0;
+			}
+			if(g_backend == BACKEND_CL)
+				clQueue.enqueueWriteBuffer(clBufferList[TILES], CL_FALSE, 0, sizeof(cl_int)*g_tileList.size(), &g_tileList[0]);
+		}
+		if(g_backend == BACKEND_CPU)
+		{
+			RenderTilesCPU(numTiles);
+			if(pCapture.get()) CaptureFrameCPU();
+		}
+		else
+		{
+			//Make sure OpenGL processing is finished
+			glFinish();
+			//Get exclusive access to GL texture object
+			clQueue.enqueueAcquireGLObjects(&clInteropList);
+			//Execute kernels
+			if(tiled)
+			{
+				//One work-group per listed screen tile; the tile is resolved as it is written out
+				clQueue.enqueueNDRangeKernel(clKernels[TRIANGLE_MSAA], cl::NullRange, cl::NDRange(TILE_SIZE*numTiles, TILE_SIZE), cl::NDRange(TILE_SIZE, TILE_SIZE), NULL, &profEvent);
+			}
+			else
+			{
+				//half_space_box only writes covered pixels: clear away what moved or went since the last frame
+				if(sceneChanged) clQueue.enqueueNDRangeKernel(clKernels[FILL], cl::NullRange, cl::NDRange(g_renderWidth, g_renderHeight), cl::NullRange);
+				clQueue.enqueueNDRangeKernel(clKernels[TRIANGLE_BOX], cl::NullRange, cl::NDRange(g_renderWidth, g_renderHeight, g_numRenderTriangles), cl::NullRange, NULL, &profEvent);
+			}
+			//Set the frame aside for capture
+			cl::Event copyEvent;
+			int captureSlot = pCapture.get() ? CopyFrameForCaptureCL(copyEvent) : -1;
+			//Release texture object
+			cl::Event releaseEvent;
+			clQueue.enqueueReleaseGLObjects(&clInteropList, NULL, &releaseEvent);
+			if(captureSlot >= 0)
+			{
+				//Let the readback run on the capture queue behind the frame; GL only needs the target back
+				clQueue.flush();
+				ReadFrameForCaptureCL(captureSlot, copyEvent);
+				releaseEvent.wait();
+			}
+			else
+			{
+				//Finish OpenCL processing
+				clQueue.finish();
+			}
+			//Get the profiling info
+			profEvent.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_START, &uStartTime);
+			profEvent.getProfilingInfo<cl_ulong>(CL_PROFILING_COMMAND_END, &uEndTime);
+		}
 	}
 	catch(cl::Error e)
 	{
@@ -577,12 +1437,16 @@ unsigned long int ExecuteKernels()
 		throw;
 	}
 	unsigned long int exTime = uEndTime - uStartTime;
+	//Adjust the resolution of the next frame to the budget
+	if(g_targetKernelTime > 0) UpdateDynamicResolution(exTime, numTiles);
 	return exTime;
 }  
 //Display function
 void Display()
 {
 	glUniform1i(glGetUniformLocation(glProgram, "tex"), 0);
+	//Stretch the rendered region over the window
+	glUniform2f(glGetUniformLocation(glProgram, "texScale"), (GLfloat)g_renderWidth/g_texWidth, (GLfloat)g_renderHeight/g_texHeight);
 
 	glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
 	glClear(GL_COLOR_BUFFER_BIT);
@@ -595,15 +1459,149 @@ void Display()
 
 	glfwSwapBuffers();
 }
-//
-////Reshape callback function
-//void reshape (int w, int h)
-//{
-//	gWindowWidth = w;
-//	gWindowHeight = h;
-//
-//	glViewport(0, 0, (GLsizei) gWindowWidth, (GLsizei) gWindowHeight);
-//}
+
+//Reshape callback function
+void GLFWCALL reshape (int w, int h)
+{
+	//Ignore minimised windows
+	if(w <= 0 || h <= 0) return;
+	g_windowWidth = w;
+	g_windowHeight = h;
+
+	glViewport(0, 0, (GLsizei) g_windowWidth, (GLsizei) g_windowHeight);
+	//The render target follows the window; it is re-created before the next frame
+	g_windowResized = (g_windowWidth != g_texWidth || g_windowHeight != g_texHeight);
+}
+
+void CompareWithNativeRasteriser(const char *kernel)
+{
+	//Read back what the kernel drew
+	std::vector<float> clOutput(4*g_texWidth*g_texHeight);
+	glBindTexture(GL_TEXTURE_2D, glTexObj);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &clOutput[0]);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	//Same frame from the native rasteriser
+	std::vector<float> cpuOutput(4*g_texWidth*g_texHeight);
+	MarkAllTilesDirty();
+	size_t numTiles = BuildTileList();
+	CPURasteriser reference(TILE_SIZE);
+	reference.Render(g_renderVerts.empty() ? NULL : &g_renderVerts[0], g_renderColours.empty() ? NULL : &g_renderColours[0], g_numRenderTriangles,
+		g_subpixelBits, &g_tileList[0], numTiles, clearColour, &cpuOutput[0], g_texWidth, g_renderWidth, g_renderHeight);
+
+	//Pixel-exact comparison over the rendered region
+	size_t mismatches = 0;
+	for(size_t y = 0; y < g_renderHeight; y++)
+	{
+		for(size_t x = 0; x < g_renderWidth; x++)
+		{
+			size_t i = (y*g_texWidth + x)*4;
+			if(memcmp(&clOutput[i], &cpuOutput[i], 4*sizeof(float)) == 0) continue;
+			if(mismatches == 0) cout << kernel << ": first mismatch at (" << x << ", " << y << ")" << endl;
+			mismatches++;
+		}
+	}
+	cout << kernel << ": " << mismatches << " of " << g_renderWidth*g_renderHeight << " pixels differ." << endl;
+}
+
+void CompareCoverage(const char *kernel)
+{
+	//For kernels that draw triangles in no particular order: each pixel must hold the colour of a triangle
+	//covering it, or the clear colour if none does. Coverage follows the native rasteriser's integer mode.
+	std::vector<float> clOutput(4*g_texWidth*g_texHeight);
+	glBindTexture(GL_TEXTURE_2D, glTexObj);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &clOutput[0]);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	//Triangles covering each pixel, and whether the kernel's colour is one of theirs
+	std::vector<unsigned int> covering(g_renderWidth*g_renderHeight, 0);
+	std::vector<bool> matched(g_renderWidth*g_renderHeight, false);
+	for(size_t t = 0; t < g_numRenderTriangles; t++)
+	{
+		const int *v = &g_renderVerts[t*6];
+		//Pixels strictly inside the bounding box, clamped to the rendered region
+		int minX = std::max(std::min(std::min(v[0], v[2]), v[4]) + 1, 0);
+		int minY = std::max(std::min(std::min(v[1], v[3]), v[5]) + 1, 0);
+		int maxX = std::min(std::max(std::max(v[0], v[2]), v[4]) - 1, (int)g_renderWidth - 1);
+		int maxY = std::min(std::max(std::max(v[1], v[3]), v[5]) - 1, (int)g_renderHeight - 1);
+		for(int y = minY; y <= maxY; y++)
+		{
+			for(int x = minX; x <= maxX; x++)
+			{
+				bool inside = true;
+				for(int e = 0; e < 3 && inside; e++)
+				{
+					long long vx = v[e*2], vy = v[e*2 + 1];
+					long long wx = v[((e + 1) % 3)*2], wy = v[((e + 1) % 3)*2 + 1];
+					inside = (vx - wx)*(y - vy) - (vy - wy)*(x - vx) > 0;
+				}
+				if(!inside) continue;
+				size_t p = y*g_renderWidth + x;
+				covering[p]++;
+				if(memcmp(&clOutput[(y*g_texWidth + x)*4], &g_renderColours[t*4], 4*sizeof(float)) == 0) matched[p] = true;
+			}
+		}
+	}
+
+	//Overlapped pixels are reported apart, as any covering triangle may legitimately win there
+	size_t single = 0, singleMismatches = 0, overlapped = 0, overlapMismatches = 0;
+	for(size_t y = 0; y < g_renderHeight; y++)
+	{
+		for(size_t x = 0; x < g_renderWidth; x++)
+		{
+			size_t p = y*g_renderWidth + x;
+			bool valid = covering[p] == 0 ? memcmp(&clOutput[(y*g_texWidth + x)*4], clearColour, 4*sizeof(float)) == 0 : matched[p];
+			if(covering[p] > 1)
+			{
+				overlapped++;
+				if(!valid) overlapMismatches++;
+				continue;
+			}
+			single++;
+			if(valid) continue;
+			if(singleMismatches == 0) cout << kernel << ": first mismatch at (" << x << ", " << y << ")" << endl;
+			singleMismatches++;
+		}
+	}
+	cout << kernel << ": " << singleMismatches << " of " << single << " empty or singly covered pixels differ, "
+		<< overlapMismatches << " of " << overlapped << " overlapped pixels hold no covering triangle's colour." << endl;
+}
+
+void ValidateCLOutput()
+{
+	cout << "Validating..." << endl;
+	//Validation frames are full, single-sampled and kept out of any capture
+	unsigned int samples = g_msaaSamples;
+	bool incremental = g_incremental;
+	unsigned long int targetTime = g_targetKernelTime;
+	unsigned int subpixelBits = g_requestedSubpixelBits;
+	std::auto_ptr<FrameCapture> capture(pCapture);
+	g_msaaSamples = 1;
+	g_targetKernelTime = 0;
+	clKernels[TRIANGLE_MSAA].setArg<cl_uint>(3, (cl_uint)g_msaaSamples);
+
+	//Tiled kernel, at the chosen vertex precision
+	g_incremental = true;
+	MarkAllTilesDirty();
+	ExecuteKernels();
+	CompareWithNativeRasteriser(kernelName[TRIANGLE_MSAA]);
+
+	//Untiled kernel, which takes integer vertices; the change of format clears the target first.
+	//It runs every triangle at once, so it is checked for coverage rather than draw order.
+	g_incremental = false;
+	SetSubpixelBits(0);
+	ExecuteKernels();
+	CompareCoverage(kernelName[TRIANGLE_BOX]);
+
+	//Back to the chosen mode
+	g_msaaSamples = samples;
+	g_incremental = incremental;
+	g_targetKernelTime = targetTime;
+	SetSubpixelBits(subpixelBits);
+	pCapture = capture;
+	clKernels[TRIANGLE_MSAA].setArg<cl_uint>(3, (cl_uint)g_msaaSamples);
+	MarkAllTilesDirty();
+}
 
 void Profile(unsigned int iNumFrames, const char *cOutputFile, std::string strMessage)
 {
@@ -662,16 +1660,27 @@ int main(void)
 	cout << "Initializing OpenGL..." << endl;
 	InitGL();
 	cout << "Complete" << endl;
-	//Initialize OpenCL
-	cout << "Initializing OpenCL..." << endl;
-	InitCL();
-	cout << "Complete" << endl;
+	//Initialize OpenCL, unless the native backend is wanted
+	SelectBackend();
+	if(g_backend == BACKEND_CL)
+	{
+		cout << "Initializing OpenCL..." << endl;
+		InitCL();
+		cout << "Complete" << endl;
+	}
 	//Generate VAO, VBO, load shaders and configure CL-GL interop
 	cout << "Configuring interoperability objects..." << endl;
 	ConfigureData();
 	cout << "Complete" << endl << endl;
+	//Offer a check of the kernels against the native rasteriser
+	if(g_backend == BACKEND_CL)
+	{
+		cout << "Validate OpenCL output against the CPU reference (Y/N) ?" << endl;
+		cin >> cResponse;
+		if(cResponse == 'y' || cResponse == 'Y') ValidateCLOutput();
+	}
 	//Set reshape callback
-//	glfwSetWindowSizeCallback(reshape);
+	glfwSetWindowSizeCallback(reshape);
 	//Ask for profiling
 	cout << "Enable profiling (Y/N) ?" << endl;
 	cin >> cResponse;
@@ -687,14 +1696,23 @@ int main(void)
 		cout << "Complete" << endl;
 	}
 	else{
+		cout << "Space: move triangles, A: add triangles, D: delete triangles, Esc: quit." << endl;
 		//Main loop
 		while(running){
+			//Space bar moves triangles around; A and D add and delete them
+			if(glfwGetKey(GLFW_KEY_SPACE)) JitterTriangle();
+			if(glfwGetKey('A')) AddRandomTriangle();
+			if(glfwGetKey('D')) RemoveRandomTriangle();
 			ExecuteKernels();
 			Display();
 			//Check if Esc pressed or window closed
 			running = !glfwGetKey(GLFW_KEY_ESC) && glfwGetWindowParam(GLFW_OPENED);
 		}
 	}
+	//Write out the remaining captured frames
+	StopCapture();
+	//Stop the native rasteriser's threads
+	pCpuRaster.reset();
 	//Close window and terminate GLFW
 	glfwTerminate();
 	//Release memory
@@ -0,0 +1,405 @@
+//Native CPU rasteriser -- see cpuraster.h
+
+#include "cpuraster.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+//MSVC emits any intrinsic without per-function target flags
+#define CPU_TARGET(isa)
+#else
+#define CPU_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+//AVX-512 intrinsics need a reasonably recent compiler
+#if !defined(_MSC_VER) || _MSC_VER >= 1910
+#define CPU_HAVE_AVX512
+#endif
+
+namespace
+{
+	//Widest SIMD width used (AVX-512)
+	const int MAX_LANES = 16;
+
+	//Lanes per instruction set
+	const int isaLanes[] = { 4, 8, 16 };
+	const char *isaName[] = { "SSE2", "AVX2", "AVX-512" };
+
+	//One triangle over one tile: edge values at the tile origin and their per-pixel steps (zero for an edge
+	//the whole tile is inside), per-lane offsets from a chunk's first pixel, and the range of pixel indices
+	//whose rows can be inside the bounding box
+	struct TileEdges
+	{
+		int origin[3];
+		int stepX[3], stepY[3];
+		int lane[3][MAX_LANES];
+		int first, last;
+	};
+
+	CPUInstructionSet DetectInstructionSet()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if(info[0] < 7) return CPU_ISA_SSE2;
+		//The OS must save the wide registers (OSXSAVE, then XCR0)
+		__cpuid(info, 1);
+		if(!(info[2] & (1 << 27))) return CPU_ISA_SSE2;
+		unsigned long long xcr0 = _xgetbv(0);
+		__cpuidex(info, 7, 0);
+		bool avx2 = (info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6;
+		bool avx512 = (info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6;
+#else
+		__builtin_cpu_init();
+		bool avx2 = __builtin_cpu_supports("avx2") != 0;
+		bool avx512 = __builtin_cpu_supports("avx512f") != 0;
+#endif
+		if(avx512) return CPU_ISA_AVX512;
+		if(avx2) return CPU_ISA_AVX2;
+		return CPU_ISA_SSE2;
+	}
+
+	//Scalar part of the setup; false if the triangle misses the tile
+	inline bool SetupTile(const CPURasteriser::TriangleSetup &tri, int x0, int y0, int tileSize, int subpixelBits, int lanes, TileEdges &edges)
+	{
+		//Bounding box test, in whole pixels
+		int x1 = x0 + tileSize - 1;
+		int y1 = y0 + tileSize - 1;
+		if(tri.bounds[0] > x1 || tri.bounds[2] < x0) return false;
+		if(tri.bounds[1] > y1 || tri.bounds[3] < y0) return false;
+
+		//Rows of the tile that can be covered, widened to whole chunks
+		int rowBegin = std::max(tri.bounds[1] - y0, 0);
+		int rowEnd = std::min(tri.bounds[3] + 1 - y0, tileSize);
+		edges.first = (rowBegin * tileSize / lanes) * lanes;
+		edges.last = rowEnd * tileSize;
+
+		//Edge values at the tile origin are set up in 64 bits. An edge that crosses the tile changes by at most
+		//reach across it, which the guard band keeps within 32 bits; edges clear of the tile are settled here.
+		int pixel = 1 << subpixelBits;
+		long long originX = (long long)x0 * pixel;
+		long long originY = (long long)y0 * pixel;
+		for(int e = 0; e < 3; e++)
+		{
+			long long value = tri.a[e]*originX + tri.b[e]*originY + tri.c[e];
+			long long reach = ((long long)abs(tri.a[e]) + abs(tri.b[e])) * tileSize * pixel;
+			if(value + reach <= 0) return false;
+			if(value - reach > 0)
+			{
+				edges.origin[e] = 1;
+				edges.stepX[e] = edges.stepY[e] = 0;
+			}
+			else
+			{
+				edges.origin[e] = (int)value;
+				edges.stepX[e] = tri.a[e] * pixel;
+				edges.stepY[e] = tri.b[e] * pixel;
+			}
+			for(int i = 0; i < lanes; i++)
+				edges.lane[e][i] = edges.stepX[e]*(i % tileSize) + edges.stepY[e]*(i / tileSize);
+		}
+		return true;
+	}
+
+	//Edge value at the first pixel of the chunk starting at pixel index chunk
+	inline int ChunkOrigin(const TileEdges &edges, int e, int chunk, int tileSize)
+	{
+		return edges.origin[e] + edges.stepX[e]*(chunk % tileSize) + edges.stepY[e]*(chunk / tileSize);
+	}
+
+	//Write a colour to the pixels of a chunk whose bits are set in mask
+	inline void WritePixels(const CPURasteriser::Frame &frame, unsigned int mask, int chunk, int x0, int y0, const float *colour)
+	{
+		for(int bit = 0; mask != 0; bit++, mask >>= 1)
+		{
+			if(!(mask & 1)) continue;
+			int x = x0 + (chunk + bit) % frame.tileSize;
+			int y = y0 + (chunk + bit) / frame.tileSize;
+			if(x < frame.width && y < frame.height)
+				memcpy(&frame.target[(y*frame.stride + x)*4], colour, 4*sizeof(float));
+		}
+	}
+
+	void ClearTile(const CPURasteriser::Frame &frame, int x0, int y0)
+	{
+		int x1 = std::min(x0 + frame.tileSize, frame.width);
+		int y1 = std::min(y0 + frame.tileSize, frame.height);
+		for(int y = y0; y < y1; y++)
+			for(int x = x0; x < x1; x++)
+				memcpy(&frame.target[(y*frame.stride + x)*4], frame.clearColour, 4*sizeof(float));
+	}
+
+	CPU_TARGET("sse2") void RasteriseTileSSE2(const CPURasteriser::Frame &frame, int tileX, int tileY)
+	{
+		const int lanes = 4;
+		int tileSize = frame.tileSize;
+		int x0 = tileX * tileSize;
+		int y0 = tileY * tileSize;
+		ClearTile(frame, x0, y0);
+
+		TileEdges edges;
+		__m128i zero = _mm_setzero_si128();
+		for(size_t t = 0; t < frame.numTriangles; t++)
+		{
+			const CPURasteriser::TriangleSetup &tri = frame.setup[t];
+			if(!SetupTile(tri, x0, y0, tileSize, frame.subpixelBits, lanes, edges)) continue;
+			__m128i lane0 = _mm_loadu_si128((const __m128i*)edges.lane[0]);
+			__m128i lane1 = _mm_loadu_si128((const __m128i*)edges.lane[1]);
+			__m128i lane2 = _mm_loadu_si128((const __m128i*)edges.lane[2]);
+
+			for(int chunk = edges.first; chunk < edges.last; chunk += lanes)
+			{
+				__m128i f1 = _mm_add_epi32(_mm_set1_epi32(ChunkOrigin(edges, 0, chunk, tileSize)), lane0);
+				__m128i f2 = _mm_add_epi32(_mm_set1_epi32(ChunkOrigin(edges, 1, chunk, tileSize)), lane1);
+				__m128i f3 = _mm_add_epi32(_mm_set1_epi32(ChunkOrigin(edges, 2, chunk, tileSize)), lane2);
+				__m128i inside = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi32(f1, zero), _mm_cmpgt_epi32(f2, zero)), _mm_cmpgt_epi32(f3, zero));
+				unsigned int mask = _mm_movemask_ps(_mm_castsi128_ps(inside));
+				if(mask) WritePixels(frame, mask, chunk, x0, y0, tri.colour);
+			}
+		}
+	}
+
+	CPU_TARGET("avx2") void RasteriseTileAVX2(const CPURasteriser::Frame &frame, int tileX, int tileY)
+	{
+		const int lanes = 8;
+		int tileSize = frame.tileSize;
+		int x0 = tileX * tileSize;
+		int y0 = tileY * tileSize;
+		ClearTile(frame, x0, y0);
+
+		TileEdges edges;
+		__m256i zero = _mm256_setzero_si256();
+		for(size_t t = 0; t < frame.numTriangles; t++)
+		{
+			const CPURasteriser::TriangleSetup &tri = frame.setup[t];
+			if(!SetupTile(tri, x0, y0, tileSize, frame.subpixelBits, lanes, edges)) continue;
+			__m256i lane0 = _mm256_loadu_si256((const __m256i*)edges.lane[0]);
+			__m256i lane1 = _mm256_loadu_si256((const __m256i*)edges.lane[1]);
+			__m256i lane2 = _mm256_loadu_si256((const __m256i*)edges.lane[2]);
+
+			for(int chunk = edges.first; chunk < edges.last; chunk += lanes)
+			{
+				__m256i f1 = _mm256_add_epi32(_mm256_set1_epi32(ChunkOrigin(edges, 0, chunk, tileSize)), lane0);
+				__m256i f2 = _mm256_add_epi32(_mm256_set1_epi32(ChunkOrigin(edges, 1, chunk, tileSize)), lane1);
+				__m256i f3 = _mm256_add_epi32(_mm256_set1_epi32(ChunkOrigin(edges, 2, chunk, tileSize)), lane2);
+				__m256i inside = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(f1, zero), _mm256_cmpgt_epi32(f2, zero)), _mm256_cmpgt_epi32(f3, zero));
+				unsigned int mask = _mm256_movemask_ps(_mm256_castsi256_ps(inside));
+				if(mask) WritePixels(frame, mask, chunk, x0, y0, tri.colour);
+			}
+		}
+	}
+
+#ifdef CPU_HAVE_AVX512
+	CPU_TARGET("avx512f") void RasteriseTileAVX512(const CPURasteriser::Frame &frame, int tileX, int tileY)
+	{
+		const int lanes = 16;
+		int tileSize = frame.tileSize;
+		int x0 = tileX * tileSize;
+		int y0 = tileY * tileSize;
+		ClearTile(frame, x0, y0);
+
+		TileEdges edges;
+		__m512i zero = _mm512_setzero_si512();
+		for(size_t t = 0; t < frame.numTriangles; t++)
+		{
+			const CPURasteriser::TriangleSetup &tri = frame.setup[t];
+			if(!SetupTile(tri, x0, y0, tileSize, frame.subpixelBits, lanes, edges)) continue;
+			__m512i lane0 = _mm512_loadu_si512(edges.lane[0]);
+			__m512i lane1 = _mm512_loadu_si512(edges.lane[1]);
+			__m512i lane2 = _mm512_loadu_si512(edges.lane[2]);
+
+			for(int chunk = edges.first; chunk < edges.last; chunk += lanes)
+			{
+				__m512i f1 = _mm512_add_epi32(_mm512_set1_epi32(ChunkOrigin(edges, 0, chunk, tileSize)), lane0);
+				__m512i f2 = _mm512_add_epi32(_mm512_set1_epi32(ChunkOrigin(edges, 1, chunk, tileSize)), lane1);
+				__m512i f3 = _mm512_add_epi32(_mm512_set1_epi32(ChunkOrigin(edges, 2, chunk, tileSize)), lane2);
+				__mmask16 inside = _mm512_cmpgt_epi32_mask(f1, zero);
+				inside = _mm512_mask_cmpgt_epi32_mask(inside, f2, zero);
+				inside = _mm512_mask_cmpgt_epi32_mask(inside, f3, zero);
+				if(inside) WritePixels(frame, inside, chunk, x0, y0, tri.colour);
+			}
+		}
+	}
+#endif
+}
+
+CPURasteriser::CPURasteriser(size_t tileSize, unsigned int numThreads, CPUInstructionSet maxIsa)
+	: m_tileSize(tileSize), m_queues(NULL), m_generation(0), m_finished(0), m_quit(false)
+{
+	//Widest instruction set the CPU has, whose chunks line up with the tile rows
+	m_isa = std::min(DetectInstructionSet(), maxIsa);
+#ifndef CPU_HAVE_AVX512
+	m_isa = std::min(m_isa, CPU_ISA_AVX2);
+#endif
+	while(m_isa > CPU_ISA_SSE2)
+	{
+		size_t lanes = isaLanes[m_isa];
+		if(lanes <= tileSize*tileSize && (tileSize % lanes == 0 || lanes % tileSize == 0)) break;
+		m_isa = (CPUInstructionSet)(m_isa - 1);
+	}
+	switch(m_isa)
+	{
+#ifdef CPU_HAVE_AVX512
+	case CPU_ISA_AVX512: m_tileFunc = RasteriseTileAVX512; break;
+#endif
+	case CPU_ISA_AVX2: m_tileFunc = RasteriseTileAVX2; break;
+	default: m_tileFunc = RasteriseTileSSE2; break;
+	}
+
+	//Thread pool
+	m_numThreads = numThreads ? numThreads : std::thread::hardware_concurrency();
+	if(m_numThreads == 0) m_numThreads = 1;
+	m_queues = new WorkQueue[m_numThreads];
+	for(unsigned int i = 1; i < m_numThreads; i++)
+		m_workers.push_back(std::thread(&CPURasteriser::WorkerLoop, this, i));
+}
+
+CPURasteriser::~CPURasteriser()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for(size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i].join();
+	delete[] m_queues;
+}
+
+const char *CPURasteriser::InstructionSetName() const
+{
+	return isaName[m_isa];
+}
+
+void CPURasteriser::Render(const int *verts, const float *colours, size_t numTriangles, unsigned int subpixelBits,
+							const int *tiles, size_t numTiles, const float *clearColour,
+							float *target, size_t stride, size_t width, size_t height)
+{
+	if(numTiles == 0) return;
+
+	//Triangle setup: bounding boxes in whole pixels and edge function coefficients in fixed point
+	m_setup.resize(numTriangles);
+	for(size_t t = 0; t < numTriangles; t++)
+	{
+		const int *v = &verts[t*6];
+		TriangleSetup &tri = m_setup[t];
+		tri.bounds[0] = std::min(std::min(v[0], v[2]), v[4]) >> subpixelBits;
+		tri.bounds[1] = std::min(std::min(v[1], v[3]), v[5]) >> subpixelBits;
+		tri.bounds[2] = std::max(std::max(v[0], v[2]), v[4]) >> subpixelBits;
+		tri.bounds[3] = std::max(std::max(v[1], v[3]), v[5]) >> subpixelBits;
+		//Edge e runs from vertex e to vertex e+1; f = (vx - wx)*(y - vy) - (vy - wy)*(x - vx)
+		for(int e = 0; e < 3; e++)
+		{
+			int vx = v[e*2], vy = v[e*2 + 1];
+			int wx = v[((e + 1) % 3)*2], wy = v[((e + 1) % 3)*2 + 1];
+			tri.a[e] = wy - vy;
+			tri.b[e] = vx - wx;
+			tri.c[e] = -((long long)tri.a[e]*vx + (long long)tri.b[e]*vy);
+			//Top-left rule in fixed point: samples exactly on a left or top edge count as inside
+			if(subpixelBits > 0 && (tri.a[e] > 0 || (tri.a[e] == 0 && tri.b[e] > 0)))
+				tri.c[e] += 1;
+		}
+		memcpy(tri.colour, &colours[t*4], 4*sizeof(float));
+	}
+
+	m_frame.setup = numTriangles ? &m_setup[0] : NULL;
+	m_frame.numTriangles = numTriangles;
+	m_frame.tiles = tiles;
+	m_frame.tileSize = (int)m_tileSize;
+	m_frame.subpixelBits = (int)subpixelBits;
+	m_frame.clearColour = clearColour;
+	m_frame.target = target;
+	m_frame.stride = stride;
+	m_frame.width = (int)width;
+	m_frame.height = (int)height;
+
+	//Hand each thread an even share of the tiles to start with
+	for(unsigned int i = 0; i < m_numThreads; i++)
+	{
+		std::lock_guard<std::mutex> lock(m_queues[i].lock);
+		m_queues[i].begin = numTiles * i / m_numThreads;
+		m_queues[i].end = numTiles * (i + 1) / m_numThreads;
+	}
+
+	//Wake the workers and join in
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_finished = 0;
+		m_generation++;
+	}
+	m_wake.notify_all();
+	RunTiles(0);
+
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_finished++;
+	while(m_finished < m_numThreads)
+		m_done.wait(lock);
+}
+
+void CPURasteriser::WorkerLoop(unsigned int id)
+{
+	unsigned int generation = 0;
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			while(!m_quit && m_generation == generation)
+				m_wake.wait(lock);
+			if(m_quit) return;
+			generation = m_generation;
+		}
+		RunTiles(id);
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if(++m_finished == m_numThreads) m_done.notify_one();
+		}
+	}
+}
+
+void CPURasteriser::RunTiles(unsigned int id)
+{
+	size_t tile;
+	while(PopTile(id, tile) || StealTile(id, tile))
+		m_tileFunc(m_frame, m_frame.tiles[tile*2], m_frame.tiles[tile*2 + 1]);
+}
+
+bool CPURasteriser::PopTile(unsigned int id, size_t &tile)
+{
+	WorkQueue &queue = m_queues[id];
+	std::lock_guard<std::mutex> lock(queue.lock);
+	if(queue.begin == queue.end) return false;
+	tile = queue.begin++;
+	return true;
+}
+
+bool CPURasteriser::StealTile(unsigned int id, size_t &tile)
+{
+	//No new work appears during a frame: if every other queue looks empty, what is left is already in hand
+	for(unsigned int i = 1; i < m_numThreads; i++)
+	{
+		WorkQueue &victim = m_queues[(id + i) % m_numThreads];
+		size_t begin, end;
+		{
+			std::lock_guard<std::mutex> lock(victim.lock);
+			size_t remaining = victim.end - victim.begin;
+			if(remaining == 0) continue;
+			//Take the back half, leaving the victim the tiles it is about to reach
+			begin = victim.end - (remaining + 1) / 2;
+			end = victim.end;
+			victim.end = begin;
+		}
+		//Run the first stolen tile now and queue the rest where others can steal them in turn
+		tile = begin;
+		std::lock_guard<std::mutex> lock(m_queues[id].lock);
+		m_queues[id].begin = begin + 1;
+		m_queues[id].end = end;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,107 @@
+//Native CPU rasteriser -- the bounding_box/half_space_box pipeline on host threads,
+//with SIMD edge function evaluation and a work-stealing pool over screen tiles
+
+#ifndef CPURASTER_H
+#define CPURASTER_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//Instruction sets for edge function evaluation, narrowest first
+typedef enum
+{
+	CPU_ISA_SSE2,
+	CPU_ISA_AVX2,
+	CPU_ISA_AVX512,
+	NUM_CPU_ISAS
+}CPUInstructionSet;
+
+class CPURasteriser
+{
+public:
+	//Edge functions f = a*x + b*y + c of one triangle, as in half_space_box, plus its bounding box and colour.
+	//Coordinates are fixed point; c is 64-bit and carries the fill rule bias.
+	struct TriangleSetup
+	{
+		int a[3], b[3];
+		long long c[3];
+		//Format: (minX, minY, maxX, maxY), in whole pixels
+		int bounds[4];
+		float colour[4];
+	};
+
+	//Everything a worker needs to rasterise a tile of the current frame
+	struct Frame
+	{
+		const TriangleSetup *setup;
+		size_t numTriangles;
+		const int *tiles;
+		int tileSize;
+		int subpixelBits;
+		const float *clearColour;
+		float *target;
+		size_t stride;
+		int width, height;
+	};
+
+	typedef void (*TileFunc)(const Frame &frame, int tileX, int tileY);
+
+	//numThreads = 0 uses every hardware thread; maxIsa caps the instruction set picked at run time
+	CPURasteriser(size_t tileSize, unsigned int numThreads = 0, CPUInstructionSet maxIsa = CPU_ISA_AVX512);
+	~CPURasteriser();
+
+	//Rasterise triangles (three int2 vertices and an RGBA colour each) into the listed tiles ((x, y) pairs)
+	//of an RGBA float target whose rows are stride pixels long. Listed tiles are cleared first, later
+	//triangles are drawn over earlier ones and nothing outside width x height is written.
+	//With subpixelBits > 0 the vertices are fixed point with that many fractional bits, pixels are sampled
+	//at their integer coordinates and the top-left fill rule applies; 0 is half_space_box's integer mode.
+	//Vertices must lie inside the guard band set by the caller, as edge stepping within a tile is 32-bit.
+	void Render(const int *verts, const float *colours, size_t numTriangles, unsigned int subpixelBits,
+				const int *tiles, size_t numTiles, const float *clearColour,
+				float *target, size_t stride, size_t width, size_t height);
+
+	CPUInstructionSet InstructionSet() const { return m_isa; }
+	const char *InstructionSetName() const;
+	unsigned int NumThreads() const { return m_numThreads; }
+
+private:
+	//Contiguous range of tile indices; the owner pops from the front, thieves split off the back
+	struct WorkQueue
+	{
+		std::mutex lock;
+		size_t begin, end;
+	};
+
+	void WorkerLoop(unsigned int id);
+	void RunTiles(unsigned int id);
+	bool PopTile(unsigned int id, size_t &tile);
+	bool StealTile(unsigned int id, size_t &tile);
+
+	//Not copyable
+	CPURasteriser(const CPURasteriser&);
+	CPURasteriser &operator=(const CPURasteriser&);
+
+	size_t m_tileSize;
+	CPUInstructionSet m_isa;
+	TileFunc m_tileFunc;
+
+	std::vector<TriangleSetup> m_setup;
+	Frame m_frame;
+
+	//Worker 0 is the thread calling Render()
+	unsigned int m_numThreads;
+	std::vector<std::thread> m_workers;
+	WorkQueue *m_queues;
+
+	//Frame hand-off between Render() and the workers
+	std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	unsigned int m_generation;
+	unsigned int m_finished;
+	bool m_quit;
+};
+
+#endif
@@ -13,6 +13,8 @@
 #define FRAGMENT_SHADER_FILE "basicFragment.frag"
 #define KERNEL_FILE "kernels.cl"
 #define TEXTURE_FILE "tex_test.png"
+#define CAPTURE_PPM_FILE "capture_%05u.ppm"
+#define CAPTURE_Y4M_FILE "capture.y4m"
 
 
 //enums
@@ -24,6 +26,7 @@ typedef enum
 	BOUND_RECT,
 	TRIANGLE_SIMPLE,
 	TRIANGLE_BOX,
+	TRIANGLE_MSAA,
 	NUM_KERNELS
 }KernelID;
 
@@ -31,15 +34,24 @@ const char *kernelName[] = {	"red",
 								"fill",
 								"bounding_box",
 								"half_space",
-								"half_space_box"};
+								"half_space_box",
+								"half_space_msaa"};
 //Enum for CL Buffer Objects
 typedef enum
 {
 	VERTS,
 	COLOURS,
-	BOUNDS
+	BOUNDS,
+	TILES
 }BufferID;
 
+//Enum for frame execution engines
+typedef enum
+{
+	BACKEND_CL,
+	BACKEND_CPU
+}BackendID;
+
 //Global constants
 //Number of test triangles
 static const size_t NUM_TRIANGLES_DEFAULT = 3;
@@ -48,6 +60,30 @@ static const size_t NUM_TRIANGLES_DEFAULT = 3;
 static const size_t WIDTH = 800;
 static const size_t HEIGHT = 600;
 
+//Dynamic resolution: smallest fraction of the window the kernels may rasterise at,
+//granularity of scale changes and frames to wait after a change before measuring again
+static const float MIN_RENDER_SCALE = 0.25f;
+static const float RENDER_SCALE_STEP = 0.0625f;
+static const unsigned int RENDER_SCALE_SETTLE_FRAMES = 10;
+
+//Frame capture: readback slots in flight and the frame rate written to Y4M headers
+static const size_t CAPTURE_SLOTS = 4;
+static const unsigned int CAPTURE_FRAME_RATE = 60;
+
+//Screen tile dimensions (one work-group per tile); WIDTH and HEIGHT should be multiples of this
+static const size_t TILE_SIZE = 8;
+
+//Multisampling: supported sample counts and number of per-sample colour slots per tile
+//Edge pixels beyond the slot count fall back to coverage-weighted blending
+static const unsigned int MSAA_MAX_SAMPLES = 8;
+static const size_t MSAA_EDGE_SLOTS = 24;
+
+//Fixed-point rasterisation: finest sub-pixel precision, in fractional bits of the render vertices
+//Finer precision shrinks the guard band, so the bits actually used also depend on the render target size
+static const unsigned int MAX_SUBPIXEL_BITS = 8;
+//Fractional bits of the scene vertices, which are in render target texels
+static const unsigned int SCENE_SUBPIXEL_BITS = 8;
+
 //Associated GL data
 GLfloat vertexCoords[] = {	-1.0f, -1.0f, 0.0f,
 							-1.0f,  1.0f, 0.0f,
@@ -59,6 +95,9 @@ GLfloat texCoords[] = {	0.0f, 1.0f,
 						1.0f, 0.0f,
 						1.0f, 1.0f};
 
+//Background colour written by kernels that own the whole render target
+float clearColour[] = {0.0f, 0.0f, 0.0f, 1.0f};
+
 //Test Triangle Data - replace later with methods to generate data for profiling purposes
 int triPixVerts[] = {	300, 200,						
 						400, 300,
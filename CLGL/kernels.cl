@@ -1,3 +1,16 @@
+//Defaults for values normally supplied by the host as build options
+#ifndef TILE_SIZE
+#define TILE_SIZE 8
+#endif
+#ifndef MSAA_MAX_SAMPLES
+#define MSAA_MAX_SAMPLES 8
+#endif
+#ifndef MSAA_EDGE_SLOTS
+#define MSAA_EDGE_SLOTS 24
+#endif
+
+#define TILE_PIXELS (TILE_SIZE * TILE_SIZE)
+
 __constant sampler_t sampler = CLK_NORMALIZED_COORDS_TRUE | CLK_ADDRESS_CLAMP | CLK_FILTER_LINEAR;
 
 __kernel void red(write_only image2d_t target)
@@ -132,4 +145,189 @@ __kernel void half_space_box(__constant int2 *in_verts, __constant float4 *in_co
 			}
 		}
 	}
+}
+
+//Sample offsets in 1/16th pixel units relative to the pixel coordinate (standard rotated-grid patterns)
+//A single sample at the pixel coordinate gives the same result as half_space
+__constant int2 msaa_pattern_1[1] = {	(int2)(0, 0)	};
+__constant int2 msaa_pattern_4[4] = {	(int2)(-2, -6), (int2)(6, -2), (int2)(-6, 2), (int2)(2, 6)	};
+__constant int2 msaa_pattern_8[8] = {	(int2)(1, -3), (int2)(-1, 3), (int2)(5, 1), (int2)(-3, -5),
+										(int2)(-5, 5), (int2)(-7, -1), (int2)(3, 7), (int2)(7, -7)	};
+
+uint count_bits(uint mask)
+{
+	uint count = 0;
+	for(; mask != 0; mask &= mask - 1) count++;
+	return count;
+}
+
+//Sets up the edge from p to q for a whole tile, in 64-bit fixed point. Returns false if the tile is entirely
+//outside the edge. Otherwise gives the edge value at the tile origin and its steps per fixed-point unit; an edge
+//crossing the tile changes by less than reach across it, which the guard band keeps within 32 bits, and an edge
+//the tile is entirely inside becomes a constant.
+bool setup_edge(long2 p, long2 q, long2 tile_origin, long tile_extent, bool top_left, int *value, int *step_x, int *step_y)
+{
+	long a = q.y - p.y;
+	long b = p.x - q.x;
+	long e = a*(tile_origin.x - p.x) + b*(tile_origin.y - p.y);
+	//Top-left rule: samples exactly on a left or top edge count as inside
+	if(top_left && (a > 0 || (a == 0 && b > 0))) e += 1;
+
+	long reach = (long)(abs(a) + abs(b)) * tile_extent;
+	if(e + reach <= 0) return false;
+	if(e - reach > 0)
+	{
+		*value = 1;
+		*step_x = *step_y = 0;
+	}
+	else
+	{
+		*value = (int)e;
+		*step_x = (int)a;
+		*step_y = (int)b;
+	}
+	return true;
+}
+
+//Renders the screen tiles listed in in_tiles, one work-group per tile; every pixel of a listed tile is rewritten.
+//With subpixel_bits > 0 the vertices are fixed point with that many fractional bits (at least 4) and the top-left
+//fill rule applies; 0 is half_space's integer mode. Vertices must lie inside the host's guard band.
+__kernel void half_space_msaa(__constant int2 *in_verts, __constant float4 *in_colour, uint num_triangles,
+								uint num_samples, float4 clear_colour, __global const int2 *in_tiles, int2 target_size,
+								uint subpixel_bits, write_only image2d_t target)
+{
+	//Per-tile colour storage: one colour per pixel, plus a small pool of per-sample colours for edge pixels
+	__local float4 tile_colour[TILE_PIXELS];
+	__local float4 tile_samples[MSAA_EDGE_SLOTS * MSAA_MAX_SAMPLES];
+	__local uint slots_used;
+	//Per-tile triangle setup for a batch of triangles: edge values at the tile origin (w: 0 if the tile is missed) and steps
+	__local int4 edge_value[TILE_PIXELS];
+	__local int4 edge_step_x[TILE_PIXELS];
+	__local int4 edge_step_y[TILE_PIXELS];
+
+	//Pixel coord
+	int2 tile = in_tiles[get_group_id(0)];
+	int x = tile.x * TILE_SIZE + get_local_id(0);
+	int y = tile.y * TILE_SIZE + get_local_id(1);
+	//Edge tiles may hang over the rendered region, which can be smaller than the target image
+	bool on_screen = x < target_size.x && y < target_size.y;
+
+	//Index of this pixel within the tile
+	uint lid = get_local_id(1) * TILE_SIZE + get_local_id(0);
+
+	__constant int2 *pattern = (num_samples == 8) ? msaa_pattern_8 : (num_samples == 4) ? msaa_pattern_4 : msaa_pattern_1;
+	uint full_mask = (1u << num_samples) - 1;
+
+	//Edge functions are evaluated in at least the 1/16th pixel units of the sample patterns
+	uint precision = max(subpixel_bits, 4u);
+	long vert_scale = 1L << (precision - subpixel_bits);
+	int pattern_scale = 1 << (precision - 4);
+	bool top_left = subpixel_bits > 0;
+	long2 tile_origin = (long2)((long)(tile.x * TILE_SIZE) << precision, (long)(tile.y * TILE_SIZE) << precision);
+	long tile_extent = (long)TILE_SIZE << precision;
+	int2 pixel_offset = (int2)((int)get_local_id(0) << precision, (int)get_local_id(1) << precision);
+
+	//Clear the tile
+	tile_colour[lid] = clear_colour;
+	if(lid == 0) slots_used = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	//Slot in the per-sample pool (-1: none yet, -2: pool exhausted) and whether it currently holds this pixel's colour
+	int slot = -1;
+	bool expanded = false;
+
+	for(uint batch = 0; batch < num_triangles; batch += TILE_PIXELS)
+	{
+		//Each work-item sets up one triangle of the batch against the whole tile
+		uint setup_id = batch + lid;
+		if(setup_id < num_triangles)
+		{
+			uint index = setup_id * 3;
+			long2 v1 = convert_long2(in_verts[index]) * vert_scale;
+			long2 v2 = convert_long2(in_verts[index + 1]) * vert_scale;
+			long2 v3 = convert_long2(in_verts[index + 2]) * vert_scale;
+
+			int value[3] = {0, 0, 0}, step_x[3] = {0, 0, 0}, step_y[3] = {0, 0, 0};
+			bool covers = setup_edge(v1, v2, tile_origin, tile_extent, top_left, &value[0], &step_x[0], &step_y[0]) &&
+							setup_edge(v2, v3, tile_origin, tile_extent, top_left, &value[1], &step_x[1], &step_y[1]) &&
+							setup_edge(v3, v1, tile_origin, tile_extent, top_left, &value[2], &step_x[2], &step_y[2]);
+			edge_value[lid] = (int4)(value[0], value[1], value[2], covers ? 1 : 0);
+			edge_step_x[lid] = (int4)(step_x[0], step_x[1], step_x[2], 0);
+			edge_step_y[lid] = (int4)(step_y[0], step_y[1], step_y[2], 0);
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		uint batch_size = min(num_triangles - batch, (uint)TILE_PIXELS);
+		for(uint i = 0; on_screen && i < batch_size; i++)
+		{
+			int4 value = edge_value[i];
+			if(value.w == 0) continue;
+			int4 step_x = edge_step_x[i];
+			int4 step_y = edge_step_y[i];
+			uint tri_id = batch + i;
+
+			//Evaluate the half-space functions at every sample position, in 32 bits relative to the tile origin
+			uint mask = 0;
+			for(uint s = 0; s < num_samples; s++)
+			{
+				int sx = pixel_offset.x + pattern[s].x * pattern_scale;
+				int sy = pixel_offset.y + pattern[s].y * pattern_scale;
+				int4 f = value + step_x*sx + step_y*sy;
+				if(f.x > 0 && f.y > 0 && f.z > 0) mask |= 1u << s;
+			}
+			if(mask == 0) continue;
+
+			//Shade once per pixel
+			float4 colour = in_colour[tri_id];
+
+			if(mask == full_mask)
+			{
+				//Fully covered: the pixel collapses back to a single colour
+				tile_colour[lid] = colour;
+				expanded = false;
+				continue;
+			}
+
+			//Edge pixel: needs per-sample storage
+			if(slot == -1)
+			{
+				slot = atomic_inc(&slots_used);
+				if(slot >= MSAA_EDGE_SLOTS) slot = -2;
+			}
+			if(slot >= 0)
+			{
+				__local float4 *samples = &tile_samples[slot * MSAA_MAX_SAMPLES];
+				if(!expanded)
+				{
+					for(uint s = 0; s < num_samples; s++) samples[s] = tile_colour[lid];
+					expanded = true;
+				}
+				for(uint s = 0; s < num_samples; s++)
+				{
+					if(mask & (1u << s)) samples[s] = colour;
+				}
+			}
+			else
+			{
+				//Out of slots: approximate with a coverage-weighted blend
+				float coverage = (float)count_bits(mask) / (float)num_samples;
+				tile_colour[lid] = mix(tile_colour[lid], colour, coverage);
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	//Resolve on write-out
+	if(on_screen)
+	{
+		float4 resolved = tile_colour[lid];
+		if(expanded)
+		{
+			__local float4 *samples = &tile_samples[slot * MSAA_MAX_SAMPLES];
+			resolved = (float4)(0.0f);
+			for(uint s = 0; s < num_samples; s++) resolved += samples[s];
+			resolved /= (float)num_samples;
+		}
+		write_imagef(target, (int2)(x, y), resolved);
+	}
 }
\ No newline at end of file